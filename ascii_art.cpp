@@ -4,14 +4,1263 @@
 #include <algorithm>
 #include <cmath>
 #include <fstream>
+#include <iterator>
 #include <stdexcept>
 #include <cstring>
+#include <cstdlib>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <cerrno>
+#if defined(_WIN32) || defined(_WIN64)
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// x86 paths need SSE2 as the compile-time baseline (always true on x86-64)
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define ASCII_ART_X86 1
+#include <immintrin.h>
+#elif defined(__ARM_NEON) || defined(__aarch64__)
+#define ASCII_ART_NEON 1
+#include <arm_neon.h>
+#endif
+
+// AVX2/AVX-512 kernels are compiled per function so the default -O2 build still
+// runs everywhere; the best one is picked at runtime (MSVC only gets the SSE2 one)
+#if defined(ASCII_ART_X86) && defined(__GNUC__)
+#define ASCII_ART_X86_DISPATCH 1
+#define ASCII_ART_TARGET(isa) __attribute__((target(isa)))
+#endif
 
 namespace ascii_art {
 
-Interpreter::Interpreter(const Config& config) : config_(config) {}
+namespace {
+
+// ---- row kernels: interleaved RGB -> BT.601 luminance -> glyph index ----
+// All of them compute exactly Interpreter::luma8 so any ISA gives byte-identical output.
+
+using GlyphRowFn = void (*)(const uint8_t* rgb, int count, const uint8_t* lut, uint8_t* glyphs);
+
+// scalar reference (and fallback for tails / unknown CPUs)
+void glyph_row_scalar(const uint8_t* rgb, int count, const uint8_t* lut, uint8_t* glyphs) {
+    for (int i = 0; i < count; ++i, rgb += 3) {
+        glyphs[i] = lut[(77u * rgb[0] + 150u * rgb[1] + 29u * rgb[2] + 128u) >> 8];
+    }
+}
+
+#if defined(ASCII_ART_X86)
+// 16-bit fixed point luma for 8 pixels already widened to epi16
+inline __m128i luma_epi16_sse2(__m128i r, __m128i g, __m128i b) {
+    __m128i acc = _mm_mullo_epi16(r, _mm_set1_epi16(77));
+    acc = _mm_add_epi16(acc, _mm_mullo_epi16(g, _mm_set1_epi16(150)));
+    acc = _mm_add_epi16(acc, _mm_mullo_epi16(b, _mm_set1_epi16(29)));
+    return _mm_srli_epi16(_mm_add_epi16(acc, _mm_set1_epi16(128)), 8);
+}
+
+// 16 pixels per step. SSE2 has no byte shuffle so RGB is split with the usual
+// unpack ladder (each round moves the data one step closer to planar).
+void glyph_row_sse2(const uint8_t* rgb, int count, const uint8_t* lut, uint8_t* glyphs) {
+    alignas(16) uint8_t luma[16];
+    const __m128i zero = _mm_setzero_si128();
+    int i = 0;
+    for (; i + 16 <= count; i += 16, rgb += 48) {
+        __m128i t00 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb));
+        __m128i t01 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 16));
+        __m128i t02 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(rgb + 32));
+
+        __m128i t10 = _mm_unpacklo_epi8(t00, _mm_unpackhi_epi64(t01, t01));
+        __m128i t11 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t00, t00), t02);
+        __m128i t12 = _mm_unpacklo_epi8(t01, _mm_unpackhi_epi64(t02, t02));
+
+        __m128i t20 = _mm_unpacklo_epi8(t10, _mm_unpackhi_epi64(t11, t11));
+        __m128i t21 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t10, t10), t12);
+        __m128i t22 = _mm_unpacklo_epi8(t11, _mm_unpackhi_epi64(t12, t12));
+
+        __m128i t30 = _mm_unpacklo_epi8(t20, _mm_unpackhi_epi64(t21, t21));
+        __m128i t31 = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t20, t20), t22);
+        __m128i t32 = _mm_unpacklo_epi8(t21, _mm_unpackhi_epi64(t22, t22));
+
+        __m128i r = _mm_unpacklo_epi8(t30, _mm_unpackhi_epi64(t31, t31));
+        __m128i g = _mm_unpacklo_epi8(_mm_unpackhi_epi64(t30, t30), t32);
+        __m128i b = _mm_unpacklo_epi8(t31, _mm_unpackhi_epi64(t32, t32));
+
+        __m128i lo = luma_epi16_sse2(_mm_unpacklo_epi8(r, zero), _mm_unpacklo_epi8(g, zero), _mm_unpacklo_epi8(b, zero));
+        __m128i hi = luma_epi16_sse2(_mm_unpackhi_epi8(r, zero), _mm_unpackhi_epi8(g, zero), _mm_unpackhi_epi8(b, zero));
+        _mm_store_si128(reinterpret_cast<__m128i*>(luma), _mm_packus_epi16(lo, hi));
+        for (int k = 0; k < 16; ++k) glyphs[i + k] = lut[luma[k]];
+    }
+    glyph_row_scalar(rgb, count - i, lut, glyphs + i);
+}
+#endif
+
+#if defined(ASCII_ART_X86_DISPATCH)
+// 16 interleaved pixels -> planar r/g/b with three byte shuffles each
+ASCII_ART_TARGET("ssse3")
+inline void deinterleave16_ssse3(const uint8_t* p, __m128i& r, __m128i& g, __m128i& b) {
+    const __m128i a0 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+    const __m128i a1 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 16));
+    const __m128i a2 = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + 32));
+    r = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a0, _mm_setr_epi8(0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 1, 4, 7, 10, 13)));
+    g = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a0, _mm_setr_epi8(1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 2, 5, 8, 11, 14)));
+    b = _mm_or_si128(_mm_or_si128(
+            _mm_shuffle_epi8(a0, _mm_setr_epi8(2, 5, 8, 11, 14, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1)),
+            _mm_shuffle_epi8(a1, _mm_setr_epi8(-1, -1, -1, -1, -1, 1, 4, 7, 10, 13, -1, -1, -1, -1, -1, -1))),
+            _mm_shuffle_epi8(a2, _mm_setr_epi8(-1, -1, -1, -1, -1, -1, -1, -1, -1, -1, 0, 3, 6, 9, 12, 15)));
+}
+
+ASCII_ART_TARGET("avx2")
+inline __m256i luma_epi16_avx2(__m256i r, __m256i g, __m256i b) {
+    __m256i acc = _mm256_mullo_epi16(r, _mm256_set1_epi16(77));
+    acc = _mm256_add_epi16(acc, _mm256_mullo_epi16(g, _mm256_set1_epi16(150)));
+    acc = _mm256_add_epi16(acc, _mm256_mullo_epi16(b, _mm256_set1_epi16(29)));
+    return _mm256_srli_epi16(_mm256_add_epi16(acc, _mm256_set1_epi16(128)), 8);
+}
+
+// 32 pixels per step: two SSSE3 deinterleaves feed one 256-bit luma pass.
+// unpack/pack both work per 128-bit lane so pixel order survives the round trip.
+ASCII_ART_TARGET("avx2")
+void glyph_row_avx2(const uint8_t* rgb, int count, const uint8_t* lut, uint8_t* glyphs) {
+    alignas(32) uint8_t luma[32];
+    const __m256i zero = _mm256_setzero_si256();
+    int i = 0;
+    for (; i + 32 <= count; i += 32, rgb += 96) {
+        __m128i r0, g0, b0, r1, g1, b1;
+        deinterleave16_ssse3(rgb, r0, g0, b0);
+        deinterleave16_ssse3(rgb + 48, r1, g1, b1);
+        __m256i r = _mm256_inserti128_si256(_mm256_castsi128_si256(r0), r1, 1);
+        __m256i g = _mm256_inserti128_si256(_mm256_castsi128_si256(g0), g1, 1);
+        __m256i b = _mm256_inserti128_si256(_mm256_castsi128_si256(b0), b1, 1);
+        __m256i lo = luma_epi16_avx2(_mm256_unpacklo_epi8(r, zero), _mm256_unpacklo_epi8(g, zero), _mm256_unpacklo_epi8(b, zero));
+        __m256i hi = luma_epi16_avx2(_mm256_unpackhi_epi8(r, zero), _mm256_unpackhi_epi8(g, zero), _mm256_unpackhi_epi8(b, zero));
+        _mm256_store_si256(reinterpret_cast<__m256i*>(luma), _mm256_packus_epi16(lo, hi));
+        for (int k = 0; k < 32; ++k) glyphs[i + k] = lut[luma[k]];
+    }
+    glyph_row_sse2(rgb, count - i, lut, glyphs + i);
+}
+
+// 64 pixels per step using 32-bit gathers at a 3 byte stride; each dword holds
+// r,g,b plus the next pixel's red, so the loop stops one pixel early to never
+// read past the row.
+#pragma GCC diagnostic push
+// gcc 12's avx512 headers trip this on their own _mm512_undefined_* placeholders
+#pragma GCC diagnostic ignored "-Wmaybe-uninitialized"
+ASCII_ART_TARGET("avx512f")
+void glyph_row_avx512(const uint8_t* rgb, int count, const uint8_t* lut, uint8_t* glyphs) {
+    alignas(64) uint8_t luma[64];
+    const __m512i offsets = _mm512_mullo_epi32(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+                                               _mm512_set1_epi32(3));
+    const __m512i mask = _mm512_set1_epi32(0xff);
+    int i = 0;
+    for (; i + 64 < count; i += 64, rgb += 192) {
+        for (int q = 0; q < 4; ++q) {
+            __m512i px = _mm512_i32gather_epi32(offsets, rgb + q * 48, 1);
+            __m512i acc = _mm512_mullo_epi32(_mm512_and_si512(px, mask), _mm512_set1_epi32(77));
+            acc = _mm512_add_epi32(acc, _mm512_mullo_epi32(_mm512_and_si512(_mm512_srli_epi32(px, 8), mask), _mm512_set1_epi32(150)));
+            acc = _mm512_add_epi32(acc, _mm512_mullo_epi32(_mm512_and_si512(_mm512_srli_epi32(px, 16), mask), _mm512_set1_epi32(29)));
+            acc = _mm512_srli_epi32(_mm512_add_epi32(acc, _mm512_set1_epi32(128)), 8);
+            _mm_store_si128(reinterpret_cast<__m128i*>(luma + q * 16), _mm512_cvtepi32_epi8(acc));
+        }
+        for (int k = 0; k < 64; ++k) glyphs[i + k] = lut[luma[k]];
+    }
+    glyph_row_avx2(rgb, count - i, lut, glyphs + i);
+}
+#pragma GCC diagnostic pop
+#endif
+
+#if defined(ASCII_ART_NEON)
+// 16 pixels per step; vld3 deinterleaves for free and vrshrn does the +128 >> 8
+void glyph_row_neon(const uint8_t* rgb, int count, const uint8_t* lut, uint8_t* glyphs) {
+    alignas(16) uint8_t luma[16];
+    const uint8x8_t wr = vdup_n_u8(77), wg = vdup_n_u8(150), wb = vdup_n_u8(29);
+    int i = 0;
+    for (; i + 16 <= count; i += 16, rgb += 48) {
+        uint8x16x3_t px = vld3q_u8(rgb);
+        uint16x8_t lo = vmull_u8(vget_low_u8(px.val[0]), wr);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[1]), wg);
+        lo = vmlal_u8(lo, vget_low_u8(px.val[2]), wb);
+        uint16x8_t hi = vmull_u8(vget_high_u8(px.val[0]), wr);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[1]), wg);
+        hi = vmlal_u8(hi, vget_high_u8(px.val[2]), wb);
+        vst1q_u8(luma, vcombine_u8(vrshrn_n_u16(lo, 8), vrshrn_n_u16(hi, 8)));
+        for (int k = 0; k < 16; ++k) glyphs[i + k] = lut[luma[k]];
+    }
+    glyph_row_scalar(rgb, count - i, lut, glyphs + i);
+}
+#endif
+
+GlyphRowFn select_glyph_row_kernel() {
+    // ASCII_ART_SIMD=scalar|sse2|avx2|avx512 caps the ISA (handy for A/B checks against the reference)
+    const char* env = std::getenv("ASCII_ART_SIMD");
+    std::string cap = env ? env : "";
+    if (cap == "scalar") return glyph_row_scalar;
+#if defined(ASCII_ART_X86_DISPATCH)
+    __builtin_cpu_init();
+    if (cap != "sse2" && cap != "avx2" && __builtin_cpu_supports("avx512f")) return glyph_row_avx512;
+    if (cap != "sse2" && __builtin_cpu_supports("avx2")) return glyph_row_avx2;
+    if (__builtin_cpu_supports("sse2")) return glyph_row_sse2;
+#elif defined(ASCII_ART_X86)
+    return glyph_row_sse2;
+#elif defined(ASCII_ART_NEON)
+    return glyph_row_neon;
+#endif
+    return glyph_row_scalar;
+}
+
+GlyphRowFn glyph_row_kernel() {
+    static const GlyphRowFn fn = select_glyph_row_kernel();
+    return fn;
+}
+
+// ---- braille dots: 2x4 tone samples per cell -> U+2800 dot bits ----
+
+// dot bit of each sample in a cell, [row][column] (Unicode numbers dots 1-3 down the
+// left column, 4-6 down the right, then 7 and 8 along the bottom)
+constexpr uint8_t kBrailleBits[4][2] = {{0x01, 0x08}, {0x02, 0x10}, {0x04, 0x20}, {0x40, 0x80}};
+
+// `tone` holds the cell row's four sample rows back to back (2 * width each); a dot
+// is set where tone >= threshold[row][sample column & 3]. Compares produce 0xff/0
+// masks that are ANDed with each sample's dot bit and ORed down the four rows; the
+// two columns of a cell are then folded together, 8 cells per 16-byte step.
+void pack_braille_row(const uint8_t* tone, int width, const uint8_t (*threshold)[4], uint8_t* glyphs) {
+    const int stride = width * 2;
+    int x = 0;
+#if defined(ASCII_ART_X86)
+    __m128i thr[4], bit[4];
+    for (int r = 0; r < 4; ++r) {
+        uint32_t t;
+        std::memcpy(&t, threshold[r], 4);
+        thr[r] = _mm_set1_epi32(static_cast<int>(t));
+        bit[r] = _mm_set1_epi16(static_cast<short>(kBrailleBits[r][0] | kBrailleBits[r][1] << 8));
+    }
+    for (; x + 8 <= width; x += 8) {
+        __m128i dots = _mm_setzero_si128();
+        for (int r = 0; r < 4; ++r) {
+            const __m128i t = _mm_loadu_si128(reinterpret_cast<const __m128i*>(tone + r * stride + x * 2));
+            const __m128i on = _mm_cmpeq_epi8(_mm_max_epu8(t, thr[r]), t);  // unsigned t >= thr
+            dots = _mm_or_si128(dots, _mm_and_si128(on, bit[r]));
+        }
+        const __m128i cell = _mm_or_si128(_mm_and_si128(dots, _mm_set1_epi16(0xff)), _mm_srli_epi16(dots, 8));
+        _mm_storel_epi64(reinterpret_cast<__m128i*>(glyphs + x), _mm_packus_epi16(cell, cell));
+    }
+#elif defined(ASCII_ART_NEON)
+    uint8x16_t thr[4], bit[4];
+    for (int r = 0; r < 4; ++r) {
+        uint32_t t;
+        std::memcpy(&t, threshold[r], 4);
+        thr[r] = vreinterpretq_u8_u32(vdupq_n_u32(t));
+        bit[r] = vreinterpretq_u8_u16(vdupq_n_u16(static_cast<uint16_t>(kBrailleBits[r][0] | kBrailleBits[r][1] << 8)));
+    }
+    for (; x + 8 <= width; x += 8) {
+        uint8x16_t dots = vdupq_n_u8(0);
+        for (int r = 0; r < 4; ++r) {
+            const uint8x16_t t = vld1q_u8(tone + r * stride + x * 2);
+            dots = vorrq_u8(dots, vandq_u8(vcgeq_u8(t, thr[r]), bit[r]));
+        }
+        // the two columns never share a bit, so a pairwise add is an OR
+        vst1_u8(glyphs + x, vmovn_u16(vpaddlq_u8(dots)));
+    }
+#endif
+    for (; x < width; ++x) {
+        uint8_t dots = 0;
+        for (int r = 0; r < 4; ++r) {
+            const uint8_t* t = tone + r * stride + x * 2;
+            if (t[0] >= threshold[r][(x * 2) & 3]) dots |= kBrailleBits[r][0];
+            if (t[1] >= threshold[r][(x * 2 + 1) & 3]) dots |= kBrailleBits[r][1];
+        }
+        glyphs[x] = dots;
+    }
+}
+
+// ---- quadrant / sextant cells: two colours per cell from a tiny 2-means ----
+
+constexpr std::array<uint8_t, 256> make_identity_lut() {
+    std::array<uint8_t, 256> lut{};
+    for (int i = 0; i < 256; ++i) lut[i] = static_cast<uint8_t>(i);
+    return lut;
+}
+// through glyph_row_kernel this turns an RGB row into plain luma8
+constexpr std::array<uint8_t, 256> kIdentityLut = make_identity_lut();
+
+// 65536 / n, so a mean of up to 6 samples is a multiply and a shift
+constexpr uint32_t kInverse[7] = {0, 65536, 32768, 21846, 16384, 13108, 10923};
+
+// Splits the 2 x Rows samples of every cell in a row into a foreground and a
+// background set. Seeded by the midpoint between the darkest and brightest luma,
+// then one Lloyd step moves each sample to the nearer of the two set means. Sample
+// i of a cell (row i / 2, column i % 2) is bit i of its mask; uniform cells get mask 0
+// with the cell's mean as background. Fixed-size loops and mask arithmetic only, so
+// there is no per-sample branching.
+template <int Rows>
+void two_means_row(const uint8_t* rgb, const uint8_t* luma, int width, uint8_t* masks, uint8_t* fg, uint8_t* bg) {
+    constexpr int N = Rows * 2;
+    constexpr unsigned kFull = (1u << N) - 1;
+    const size_t stride = static_cast<size_t>(width) * 2;
+    for (int x = 0; x < width; ++x) {
+        int px[N][3];
+        int l[N];
+        for (int i = 0; i < N; ++i) {
+            const size_t s = (i >> 1) * stride + x * 2 + (i & 1);
+            l[i] = luma[s];
+            for (int ch = 0; ch < 3; ++ch) px[i][ch] = rgb[s * 3 + ch];
+        }
+        int lo = l[0], hi = l[0];
+        for (int i = 1; i < N; ++i) {
+            lo = std::min(lo, l[i]);
+            hi = std::max(hi, l[i]);
+        }
+        const int split = (lo + hi + 1) >> 1;
+        unsigned mask = 0;
+        for (int i = 0; i < N; ++i) mask |= unsigned(l[i] >= split && lo != hi) << i;
+
+        int mean[2][3];
+        auto set_means = [&] {
+            int sum[2][3] = {};
+            int n_fg = 0;
+            for (int i = 0; i < N; ++i) {
+                const int side = (mask >> i) & 1;
+                n_fg += side;
+                for (int ch = 0; ch < 3; ++ch) sum[side][ch] += px[i][ch];
+            }
+            // an empty side copies the other one, which then is the whole cell
+            for (int ch = 0; ch < 3; ++ch) {
+                mean[1][ch] = n_fg ? (sum[1][ch] * kInverse[n_fg] + 32768) >> 16 : 0;
+                mean[0][ch] = n_fg < N ? (sum[0][ch] * kInverse[N - n_fg] + 32768) >> 16 : mean[1][ch];
+                if (!n_fg) mean[1][ch] = mean[0][ch];
+            }
+        };
+        set_means();
+        unsigned refined = 0;
+        for (int i = 0; i < N; ++i) {
+            int d_fg = 0, d_bg = 0;
+            for (int ch = 0; ch < 3; ++ch) {
+                d_fg += (px[i][ch] - mean[1][ch]) * (px[i][ch] - mean[1][ch]);
+                d_bg += (px[i][ch] - mean[0][ch]) * (px[i][ch] - mean[0][ch]);
+            }
+            refined |= unsigned(d_fg < d_bg) << i;
+        }
+        mask = refined == kFull ? 0 : refined;
+        set_means();
+        masks[x] = static_cast<uint8_t>(mask);
+        for (int ch = 0; ch < 3; ++ch) {
+            fg[x * 3 + ch] = static_cast<uint8_t>(mean[1][ch]);
+            bg[x * 3 + ch] = static_cast<uint8_t>(mean[0][ch]);
+        }
+    }
+}
+
+// ---- edge cells: Sobel over each cell's 3x3 luma samples -> | / - \ _ or tone ----
+
+// tone glyphs ahead of | / - \ _ in the EDGE table
+constexpr int kEdgeRamp = 10;
+
+// Vertical taps of the Sobel pair over the three sample rows of a cell row, per
+// column: 1-2-1 smoothing (gx and the blurred tone), bottom minus top (gy) and
+// bottom minus middle (whether a horizontal edge sits low in the cell).
+void edge_columns(const uint8_t* r0, const uint8_t* r1, const uint8_t* r2, int count, int16_t* smooth,
+                  int16_t* step, int16_t* low) {
+    int i = 0;
+#if defined(ASCII_ART_X86)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r0 + i));
+        const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r1 + i));
+        const __m128i c = _mm_loadu_si128(reinterpret_cast<const __m128i*>(r2 + i));
+        for (int half = 0; half < 2; ++half) {
+            const __m128i a16 = half ? _mm_unpackhi_epi8(a, zero) : _mm_unpacklo_epi8(a, zero);
+            const __m128i b16 = half ? _mm_unpackhi_epi8(b, zero) : _mm_unpacklo_epi8(b, zero);
+            const __m128i c16 = half ? _mm_unpackhi_epi8(c, zero) : _mm_unpacklo_epi8(c, zero);
+            const __m128i s = _mm_add_epi16(_mm_add_epi16(a16, c16), _mm_slli_epi16(b16, 1));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(smooth + i + half * 8), s);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(step + i + half * 8), _mm_sub_epi16(c16, a16));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(low + i + half * 8), _mm_sub_epi16(c16, b16));
+        }
+    }
+#elif defined(ASCII_ART_NEON)
+    for (; i + 16 <= count; i += 16) {
+        const uint8x16_t a = vld1q_u8(r0 + i), b = vld1q_u8(r1 + i), c = vld1q_u8(r2 + i);
+        const uint8x8_t al = vget_low_u8(a), bl = vget_low_u8(b), cl = vget_low_u8(c);
+        const uint8x8_t ah = vget_high_u8(a), bh = vget_high_u8(b), ch = vget_high_u8(c);
+        // u16 differences wrap to the right s16 values
+        vst1q_s16(smooth + i, vreinterpretq_s16_u16(vaddq_u16(vaddl_u8(al, cl), vshll_n_u8(bl, 1))));
+        vst1q_s16(smooth + i + 8, vreinterpretq_s16_u16(vaddq_u16(vaddl_u8(ah, ch), vshll_n_u8(bh, 1))));
+        vst1q_s16(step + i, vreinterpretq_s16_u16(vsubl_u8(cl, al)));
+        vst1q_s16(step + i + 8, vreinterpretq_s16_u16(vsubl_u8(ch, ah)));
+        vst1q_s16(low + i, vreinterpretq_s16_u16(vsubl_u8(cl, bl)));
+        vst1q_s16(low + i + 8, vreinterpretq_s16_u16(vsubl_u8(ch, bh)));
+    }
+#endif
+    for (; i < count; ++i) {
+        smooth[i] = static_cast<int16_t>(r0[i] + 2 * r1[i] + r2[i]);
+        step[i] = static_cast<int16_t>(r2[i] - r0[i]);
+        low[i] = static_cast<int16_t>(r2[i] - r1[i]);
+    }
+}
+
+// `luma` holds the cell row's three sample rows back to back (3 * width each). The
+// horizontal taps finish gx / gy per cell; cells whose |gx| + |gy| exceeds
+// `threshold` get the glyph for the edge direction (perpendicular to the gradient,
+// y pointing down), the rest the tone of their 3x3 binomial blur through `lut`.
+void edge_row(const uint8_t* luma, int width, const uint8_t* lut, int threshold, uint8_t* glyphs) {
+    constexpr int kChunk = 16;  // cells per pass through the column taps
+    alignas(16) int16_t smooth[kChunk * 3], step[kChunk * 3], low[kChunk * 3];
+    const size_t stride = static_cast<size_t>(width) * 3;
+    for (int x0 = 0; x0 < width; x0 += kChunk) {
+        const int cells = std::min(kChunk, width - x0);
+        const uint8_t* top = luma + x0 * 3;
+        edge_columns(top, top + stride, top + stride * 2, cells * 3, smooth, step, low);
+        for (int k = 0; k < cells; ++k) {
+            const int16_t* s = smooth + k * 3;
+            const int16_t* d = step + k * 3;
+            const int gx = s[2] - s[0];
+            const int gy = d[0] + 2 * d[1] + d[2];
+            const int ax = std::abs(gx), ay = std::abs(gy);
+            uint8_t glyph = lut[(s[0] + 2 * s[1] + s[2] + 8) >> 4];
+            if (ax + ay > threshold) {
+                // 22.5 degree sectors: tan(22.5) ~ 5/12
+                if (ay * 12 < ax * 5) {
+                    glyph = kEdgeRamp;  // |
+                } else if (ax * 12 < ay * 5) {
+                    const int16_t* l = low + k * 3;
+                    const int lower = l[0] + 2 * l[1] + l[2];
+                    glyph = std::abs(lower) > 2 * std::abs(gy - lower) ? kEdgeRamp + 4 : kEdgeRamp + 2;  // _ or -
+                } else {
+                    glyph = (gx ^ gy) >= 0 ? kEdgeRamp + 1 : kEdgeRamp + 3;  // / or backslash
+                }
+            }
+            glyphs[x0 + k] = glyph;
+        }
+    }
+}
+
+// ---- shape cells: 4x8 coverage samples per cell matched against glyph bitmaps ----
+
+// Hand-drawn 4x8 coverage of each glyph (top row first), roughly how a terminal
+// font fills its cell. The SHAPE glyph table is this list in the same order.
+struct GlyphShape {
+    std::string_view glyph;
+    const char* rows[8];
+};
+
+constexpr GlyphShape kShapeAtlas[] = {
+    {" ", {"....", "....", "....", "....", "....", "....", "....", "...."}},
+    {".", {"....", "....", "....", "....", "....", "....", ".##.", "...."}},
+    {",", {"....", "....", "....", "....", "....", ".##.", ".##.", ".#.."}},
+    {"'", {".##.", ".##.", "....", "....", "....", "....", "....", "...."}},
+    {"`", {".#..", "..#.", "....", "....", "....", "....", "....", "...."}},
+    {"^", {".##.", "#..#", "....", "....", "....", "....", "....", "...."}},
+    {"-", {"....", "....", "....", "....", "####", "....", "....", "...."}},
+    {"_", {"....", "....", "....", "....", "....", "....", "....", "####"}},
+    {"=", {"....", "....", "....", "####", "....", "####", "....", "...."}},
+    {":", {"....", "....", ".##.", "....", "....", ".##.", "....", "...."}},
+    {";", {"....", "....", ".##.", "....", "....", ".##.", ".##.", ".#.."}},
+    {"!", {".##.", ".##.", ".##.", ".##.", ".##.", "....", ".##.", "...."}},
+    {"|", {".##.", ".##.", ".##.", ".##.", ".##.", ".##.", ".##.", ".##."}},
+    {"/", {"...#", "...#", "..#.", "..#.", ".#..", ".#..", "#...", "#..."}},
+    {"\\", {"#...", "#...", ".#..", ".#..", "..#.", "..#.", "...#", "...#"}},
+    {"(", {"..#.", ".#..", ".#..", ".#..", ".#..", ".#..", ".#..", "..#."}},
+    {")", {".#..", "..#.", "..#.", "..#.", "..#.", "..#.", "..#.", ".#.."}},
+    {"[", {".##.", ".#..", ".#..", ".#..", ".#..", ".#..", ".#..", ".##."}},
+    {"]", {".##.", "..#.", "..#.", "..#.", "..#.", "..#.", "..#.", ".##."}},
+    {"<", {"....", "...#", "..#.", ".#..", "#...", ".#..", "..#.", "...#"}},
+    {">", {"....", "#...", ".#..", "..#.", "...#", "..#.", ".#..", "#..."}},
+    {"+", {"....", "....", ".##.", ".##.", "####", ".##.", ".##.", "...."}},
+    {"*", {"....", "....", "#..#", ".##.", "####", ".##.", "#..#", "...."}},
+    {"x", {"....", "....", "#..#", ".##.", ".##.", ".##.", "#..#", "...."}},
+    {"v", {"....", "....", "#..#", "#..#", "#..#", ".##.", ".##.", "...."}},
+    {"c", {"....", "....", ".###", "#...", "#...", "#...", ".###", "...."}},
+    {"r", {"....", "....", "#.##", "##..", "#...", "#...", "#...", "...."}},
+    {"i", {".##.", "....", ".##.", ".##.", ".##.", ".##.", ".##.", "...."}},
+    {"l", {".##.", ".##.", ".##.", ".##.", ".##.", ".##.", "..##", "...."}},
+    {"T", {"####", ".##.", ".##.", ".##.", ".##.", ".##.", ".##.", "...."}},
+    {"L", {"#...", "#...", "#...", "#...", "#...", "#...", "####", "...."}},
+    {"7", {"####", "...#", "..#.", "..#.", ".#..", ".#..", ".#..", "...."}},
+    {"Y", {"#..#", "#..#", ".##.", ".##.", ".##.", ".##.", ".##.", "...."}},
+    {"V", {"#..#", "#..#", "#..#", "#..#", "#..#", ".##.", ".##.", "...."}},
+    {"z", {"....", "....", "####", "...#", ".##.", "#...", "####", "...."}},
+    {"s", {"....", "....", ".###", "#...", ".##.", "...#", "###.", "...."}},
+    {"o", {"....", "....", ".##.", "#..#", "#..#", "#..#", ".##.", "...."}},
+    {"n", {"....", "....", "###.", "#..#", "#..#", "#..#", "#..#", "...."}},
+    {"u", {"....", "....", "#..#", "#..#", "#..#", "#..#", ".###", "...."}},
+    {"e", {"....", "....", ".##.", "#..#", "####", "#...", ".###", "...."}},
+    {"a", {"....", "....", ".##.", "...#", ".###", "#..#", ".###", "...."}},
+    {"p", {"....", "....", "###.", "#..#", "#..#", "###.", "#...", "#..."}},
+    {"q", {"....", "....", ".###", "#..#", "#..#", ".###", "...#", "...#"}},
+    {"b", {"#...", "#...", "###.", "#..#", "#..#", "#..#", "###.", "...."}},
+    {"d", {"...#", "...#", ".###", "#..#", "#..#", "#..#", ".###", "...."}},
+    {"U", {"#..#", "#..#", "#..#", "#..#", "#..#", "#..#", ".##.", "...."}},
+    {"O", {".##.", "#..#", "#..#", "#..#", "#..#", "#..#", ".##.", "...."}},
+    {"A", {".##.", "#..#", "#..#", "####", "#..#", "#..#", "#..#", "...."}},
+    {"H", {"#..#", "#..#", "#..#", "####", "#..#", "#..#", "#..#", "...."}},
+    {"P", {"###.", "#..#", "#..#", "###.", "#...", "#...", "#...", "...."}},
+    {"E", {"####", "#...", "#...", "###.", "#...", "#...", "####", "...."}},
+    {"8", {".##.", "#..#", "#..#", ".##.", "#..#", "#..#", ".##.", "...."}},
+    {"#", {"....", ".#.#", "####", ".#.#", ".#.#", "####", ".#.#", "...."}},
+    {"M", {"#..#", "####", "####", "#..#", "#..#", "#..#", "#..#", "...."}},
+    {"W", {"#..#", "#..#", "#..#", "#..#", "####", "####", "#..#", "...."}},
+    {"@", {".##.", "#..#", "#.##", "#.##", "#.##", "#...", ".###", "...."}},
+};
+constexpr int kShapeCount = static_cast<int>(std::size(kShapeAtlas));
+
+constexpr std::array<std::string_view, kShapeCount> make_shape_glyphs() {
+    std::array<std::string_view, kShapeCount> glyphs{};
+    for (int g = 0; g < kShapeCount; ++g) glyphs[g] = kShapeAtlas[g].glyph;
+    return glyphs;
+}
+constexpr std::array<std::string_view, kShapeCount> kShapeGlyphs = make_shape_glyphs();
+
+// the atlas as 0/255 coverage bytes, ordered by ink so the search can start at a
+// cell's own density
+struct ShapeTable {
+    alignas(16) uint8_t coverage[kShapeCount][32];
+    int ink[kShapeCount];      // sum of the coverage bytes
+    uint8_t glyph[kShapeCount];  // index into kShapeAtlas
+};
+
+ShapeTable build_shape_table() {
+    ShapeTable table{};
+    int order[kShapeCount];
+    int ink[kShapeCount];
+    for (int g = 0; g < kShapeCount; ++g) {
+        order[g] = g;
+        ink[g] = 0;
+        for (int r = 0; r < 8; ++r) {
+            for (int c = 0; c < 4; ++c) ink[g] += kShapeAtlas[g].rows[r][c] == '#';
+        }
+    }
+    std::stable_sort(order, order + kShapeCount, [&](int a, int b) { return ink[a] < ink[b]; });
+    for (int k = 0; k < kShapeCount; ++k) {
+        const GlyphShape& shape = kShapeAtlas[order[k]];
+        for (int i = 0; i < 32; ++i) table.coverage[k][i] = shape.rows[i >> 2][i & 3] == '#' ? 255 : 0;
+        table.ink[k] = ink[order[k]] * 255;
+        table.glyph[k] = static_cast<uint8_t>(order[k]);
+    }
+    return table;
+}
+
+const ShapeTable& shape_table() {
+    static const ShapeTable table = build_shape_table();
+    return table;
+}
+
+// sum of absolute differences of two 32-byte blocks (PSADBW / VABD)
+inline int sad32(const uint8_t* a, const uint8_t* b) {
+#if defined(ASCII_ART_X86)
+    const __m128i lo = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a)),
+                                    _mm_load_si128(reinterpret_cast<const __m128i*>(b)));
+    const __m128i hi = _mm_sad_epu8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + 16)),
+                                    _mm_load_si128(reinterpret_cast<const __m128i*>(b + 16)));
+    const __m128i sum = _mm_add_epi64(lo, hi);
+    return _mm_cvtsi128_si32(sum) + _mm_cvtsi128_si32(_mm_srli_si128(sum, 8));
+#elif defined(ASCII_ART_NEON)
+    uint16x8_t sum = vpaddlq_u8(vabdq_u8(vld1q_u8(a), vld1q_u8(b)));
+    sum = vpadalq_u8(sum, vabdq_u8(vld1q_u8(a + 16), vld1q_u8(b + 16)));
+    const uint64x2_t total = vpaddlq_u32(vpaddlq_u16(sum));
+    return static_cast<int>(vgetq_lane_u64(total, 0) + vgetq_lane_u64(total, 1));
+#else
+    int sum = 0;
+    for (int i = 0; i < 32; ++i) sum += std::abs(a[i] - b[i]);
+    return sum;
+#endif
+}
+
+// `tone` holds the cell row's eight sample rows back to back (4 * width each). Each
+// cell's 32 coverage bytes are scored against the atlas as SAD + |ink(cell) -
+// ink(glyph)|: SAD alone turns flat greys into a 50% threshold (blank or the
+// densest glyph), the ink term keeps the overall density. The ink gap is also a
+// lower bound of the SAD, so the search walks outwards from the cell's ink in the
+// sorted table and stops once twice the gap can't beat the best score so far;
+// flat cells end after a handful of glyphs.
+void match_shape_row(const uint8_t* tone, int width, uint8_t* glyphs) {
+    const ShapeTable& table = shape_table();
+    const size_t stride = static_cast<size_t>(width) * 4;
+    alignas(16) uint8_t cell[32];
+    for (int x = 0; x < width; ++x) {
+        for (int r = 0; r < 8; ++r) std::memcpy(cell + r * 4, tone + r * stride + x * 4, 4);
+        int ink = 0;
+        for (int i = 0; i < 32; ++i) ink += cell[i];
+        int hi = static_cast<int>(std::lower_bound(table.ink, table.ink + kShapeCount, ink) - table.ink);
+        int lo = hi - 1;
+        constexpr int kFar = 1 << 30;
+        int best = kFar, best_glyph = 0;
+        for (;;) {
+            const int gap_lo = lo >= 0 ? ink - table.ink[lo] : kFar;
+            const int gap_hi = hi < kShapeCount ? table.ink[hi] - ink : kFar;
+            const int gap = std::min(gap_lo, gap_hi);
+            if (gap >= kFar || gap * 2 >= best) break;
+            const int k = gap_lo <= gap_hi ? lo-- : hi++;
+            const int score = sad32(cell, table.coverage[k]) + gap;
+            if (score < best) {
+                best = score;
+                best_glyph = table.glyph[k];
+            }
+        }
+        glyphs[x] = static_cast<uint8_t>(best_glyph);
+    }
+}
+
+// ---- resampling passes (vertical, the part that touches every source byte) ----
+
+// box filter: acc[i] += src[i] for one source row
+void accumulate_row(uint32_t* acc, const uint8_t* src, int count) {
+    int i = 0;
+#if defined(ASCII_ART_X86)
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 16 <= count; i += 16) {
+        __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(src + i));
+        __m128i lo = _mm_unpacklo_epi8(v, zero);
+        __m128i hi = _mm_unpackhi_epi8(v, zero);
+        __m128i* a = reinterpret_cast<__m128i*>(acc + i);
+        _mm_storeu_si128(a, _mm_add_epi32(_mm_loadu_si128(a), _mm_unpacklo_epi16(lo, zero)));
+        _mm_storeu_si128(a + 1, _mm_add_epi32(_mm_loadu_si128(a + 1), _mm_unpackhi_epi16(lo, zero)));
+        _mm_storeu_si128(a + 2, _mm_add_epi32(_mm_loadu_si128(a + 2), _mm_unpacklo_epi16(hi, zero)));
+        _mm_storeu_si128(a + 3, _mm_add_epi32(_mm_loadu_si128(a + 3), _mm_unpackhi_epi16(hi, zero)));
+    }
+#elif defined(ASCII_ART_NEON)
+    for (; i + 16 <= count; i += 16) {
+        uint8x16_t v = vld1q_u8(src + i);
+        uint16x8_t lo = vmovl_u8(vget_low_u8(v));
+        uint16x8_t hi = vmovl_u8(vget_high_u8(v));
+        vst1q_u32(acc + i, vaddw_u16(vld1q_u32(acc + i), vget_low_u16(lo)));
+        vst1q_u32(acc + i + 4, vaddw_u16(vld1q_u32(acc + i + 4), vget_high_u16(lo)));
+        vst1q_u32(acc + i + 8, vaddw_u16(vld1q_u32(acc + i + 8), vget_low_u16(hi)));
+        vst1q_u32(acc + i + 12, vaddw_u16(vld1q_u32(acc + i + 12), vget_high_u16(hi)));
+    }
+#endif
+    for (; i < count; ++i) acc[i] += src[i];
+}
+
+// bilinear: out = (a * (256 - w) + b * w + 128) >> 8 on 8-bit values held in 16 bits
+void blend_rows(uint16_t* out, const uint16_t* a, const uint16_t* b, int weight, int count) {
+    int i = 0;
+#if defined(ASCII_ART_X86)
+    const __m128i wa = _mm_set1_epi16(static_cast<short>(256 - weight));
+    const __m128i wb = _mm_set1_epi16(static_cast<short>(weight));
+    const __m128i half = _mm_set1_epi16(128);
+    for (; i + 8 <= count; i += 8) {
+        __m128i va = _mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i));
+        __m128i vb = _mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i));
+        __m128i v = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(va, wa), _mm_mullo_epi16(vb, wb)), half);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out + i), _mm_srli_epi16(v, 8));
+    }
+#elif defined(ASCII_ART_NEON)
+    const uint16x8_t wa = vdupq_n_u16(static_cast<uint16_t>(256 - weight));
+    const uint16x8_t wb = vdupq_n_u16(static_cast<uint16_t>(weight));
+    for (; i + 8 <= count; i += 8) {
+        uint16x8_t v = vmlaq_u16(vmulq_u16(vld1q_u16(a + i), wa), vld1q_u16(b + i), wb);
+        vst1q_u16(out + i, vrshrq_n_u16(v, 8));
+    }
+#endif
+    for (; i < count; ++i) out[i] = static_cast<uint16_t>((a[i] * (256 - weight) + b[i] * weight + 128) >> 8);
+}
+
+// ---- output writers: encode_row runs once with each (measure, then write) ----
+
+// "0;" .. "255;" for every byte value, so an SGR parameter is one fixed-size copy
+struct DecimalText {
+    char text[4];
+    uint8_t size;  // digits only, without the ';'
+};
+
+constexpr std::array<DecimalText, 256> make_decimal_table() {
+    std::array<DecimalText, 256> table{};
+    for (int v = 0; v < 256; ++v) {
+        DecimalText& d = table[v];
+        int n = 0;
+        if (v >= 100) d.text[n++] = static_cast<char>('0' + v / 100);
+        if (v >= 10) d.text[n++] = static_cast<char>('0' + v / 10 % 10);
+        d.text[n++] = static_cast<char>('0' + v % 10);
+        d.size = static_cast<uint8_t>(n);
+        for (; n < 4; ++n) d.text[n] = ';';
+    }
+    return table;
+}
+
+constexpr std::array<DecimalText, 256> kDecimal = make_decimal_table();
+
+// colour plane values are 0xRRGGBB, so this never matches a real colour
+constexpr uint32_t kNoColor = 0xffffffffu;
+
+// convert_delta(): unchanged cells between two changed ones are rewritten rather than
+// skipped when the gap is at most this wide (about the cost of a cursor move)
+constexpr int kDeltaGap = 6;
+
+inline int decimal_digits(int n) {
+    int digits = 1;
+    for (; n >= 10; n /= 10) ++digits;
+    return digits;
+}
+
+// "\x1b[38;2;" + r;g;b + "m"
+inline size_t truecolor_escape_size(uint8_t r, uint8_t g, uint8_t b) {
+    return 7 + kDecimal[r].size + 1 + kDecimal[g].size + 1 + kDecimal[b].size + 1;
+}
+
+struct ByteCounter {
+    size_t size = 0;
+    void put(const char*, size_t len) { size += len; }
+    void repeat(std::string_view glyph, int count) { size += glyph.size() * count; }
+    void csi(int n, char) { size += 3 + decimal_digits(n); }
+    void cursor_to(int row, int col) { size += 4 + decimal_digits(row + 1) + decimal_digits(col + 1); }
+    void color(uint8_t r, uint8_t g, uint8_t b, bool = false) { size += truecolor_escape_size(r, g, b); }
+    template <ColorDepth Depth>
+    void escape(uint32_t color, bool background = false) {
+        if constexpr (Depth == ColorDepth::TRUECOLOR) {
+            this->color(uint8_t(color >> 16), uint8_t(color >> 8), uint8_t(color));
+        } else if constexpr (Depth == ColorDepth::ANSI256) {
+            size += 7 + kDecimal[color].size + 1;  // "\x1b[38;5;" n "m"
+        } else {
+            size += background && color >= 8 ? 6 : 5;  // "\x1b[3Xm" / "\x1b[9Xm" / "\x1b[4Xm" / "\x1b[10Xm"
+        }
+    }
+};
+
+struct ByteWriter {
+    char* p;
+    void put(const char* s, size_t len) {
+        std::memcpy(p, s, len);
+        p += len;
+    }
+    void repeat(std::string_view glyph, int count) {
+        if (glyph.size() == 1) {
+            std::memset(p, glyph[0], count);
+            p += count;
+        } else {
+            for (int i = 0; i < count; ++i) put(glyph.data(), glyph.size());
+        }
+    }
+    void number(int n) {
+        const int digits = decimal_digits(n);
+        for (int i = digits - 1; i >= 0; --i, n /= 10) p[i] = static_cast<char>('0' + n % 10);
+        p += digits;
+    }
+    // "\x1b[" n final, for the REP / ECH / CUF run compression
+    void csi(int n, char final) {
+        *p++ = '\x1b';
+        *p++ = '[';
+        number(n);
+        *p++ = final;
+    }
+    // CUP to a 0-based cell
+    void cursor_to(int row, int col) {
+        *p++ = '\x1b';
+        *p++ = '[';
+        number(row + 1);
+        *p++ = ';';
+        number(col + 1);
+        *p++ = 'H';
+    }
+    void color(uint8_t r, uint8_t g, uint8_t b, bool background = false) {
+        // straight into the frame: no snprintf, no hashing, no temporary strings.
+        // r and g copy all 4 table bytes (digits + ';' padding) and only advance past
+        // "digits;", the spare bytes land where the next parameter is written anyway
+        std::memcpy(p, background ? "\x1b[48;2;" : "\x1b[38;2;", 7);
+        p += 7;
+        std::memcpy(p, kDecimal[r].text, 4);
+        p += kDecimal[r].size + 1;
+        std::memcpy(p, kDecimal[g].text, 4);
+        p += kDecimal[g].size + 1;
+        std::memcpy(p, kDecimal[b].text, kDecimal[b].size);
+        p += kDecimal[b].size;
+        *p++ = 'm';
+    }
+    // colour plane value -> foreground (or background) SGR for the given depth
+    template <ColorDepth Depth>
+    void escape(uint32_t color, bool background = false) {
+        if constexpr (Depth == ColorDepth::TRUECOLOR) {
+            this->color(uint8_t(color >> 16), uint8_t(color >> 8), uint8_t(color), background);
+        } else if constexpr (Depth == ColorDepth::ANSI256) {
+            std::memcpy(p, background ? "\x1b[48;5;" : "\x1b[38;5;", 7);
+            p += 7;
+            std::memcpy(p, kDecimal[color].text, kDecimal[color].size);
+            p += kDecimal[color].size;
+            *p++ = 'm';
+        } else if (!background) {
+            const char esc[5] = {'\x1b', '[', color < 8 ? '3' : '9', static_cast<char>('0' + (color & 7)), 'm'};
+            std::memcpy(p, esc, 5);
+            p += 5;
+        } else if (color < 8) {
+            const char esc[5] = {'\x1b', '[', '4', static_cast<char>('0' + color), 'm'};
+            std::memcpy(p, esc, 5);
+            p += 5;
+        } else {
+            const char esc[6] = {'\x1b', '[', '1', '0', static_cast<char>('0' + (color & 7)), 'm'};
+            std::memcpy(p, esc, 6);
+            p += 6;
+        }
+    }
+};
+
+// colours the terminal currently has set, carried across the runs of a row
+struct SgrState {
+    uint32_t fg = kNoColor;
+    uint32_t bg = kNoColor;
+    bool set() const { return fg != kNoColor || bg != kNoColor; }
+};
+
+// one run-length encoded stretch of a row; `sgr` is updated as escapes are written.
+// `backgrounds` is only passed for two-colour modes
+template <bool Color, ColorDepth Depth, typename Writer>
+void encode_cells(Writer& out, const std::string_view* glyph_text, const uint8_t* glyphs, const uint32_t* colors,
+                  const uint32_t* backgrounds, int count, bool line_end, SgrState& sgr, bool compress) {
+    // a run as plain glyphs, or with compress_runs as one glyph + CSI n b (REP)
+    // once the escape is shorter than the copies it replaces
+    auto glyph_run = [&](std::string_view text, int n) {
+        if (compress && n > 1 && 3 + decimal_digits(n - 1) < static_cast<int>(text.size()) * (n - 1)) {
+            out.put(text.data(), text.size());
+            out.csi(n - 1, 'b');
+        } else {
+            out.repeat(text, n);
+        }
+    };
+    // blanks at the end of a line become EL, wide gaps ECH (erase) + CUF (skip) so a
+    // frame drawn over the previous one still clears what was there
+    auto blank_run = [&](int n, bool trailing) {
+        if (compress && trailing && n > 3) {
+            out.put("\x1b[K", 3);
+        } else if (compress && 2 * (3 + decimal_digits(n)) < n) {
+            out.csi(n, 'X');
+            out.csi(n, 'C');
+        } else {
+            out.repeat(glyph_text[0], n);
+        }
+    };
+    int x = 0;
+    while (x < count) {
+        const uint8_t glyph = glyphs[x];
+
+        // extend run while glyph and color match (this is ripped lol)
+        int run_start = x;
+        ++x;
+        if constexpr (Color) {
+            if (backgrounds) {
+                // two-colour cells: glyph 0 shows only its background, any other glyph both.
+                // blanks are real cells here, so they are never erased or skipped
+                const uint32_t back = backgrounds[run_start];
+                if (glyph == 0) {
+                    while (x < count && glyphs[x] == 0 && backgrounds[x] == back) ++x;
+                } else {
+                    const uint32_t fore = colors[run_start];
+                    while (x < count && glyphs[x] == glyph && colors[x] == fore && backgrounds[x] == back) ++x;
+                    if (fore != sgr.fg) {
+                        out.template escape<Depth>(fore);
+                        sgr.fg = fore;
+                    }
+                }
+                if (back != sgr.bg) {
+                    out.template escape<Depth>(back, true);
+                    sgr.bg = back;
+                }
+                glyph_run(glyph_text[glyph], x - run_start);
+                continue;
+            }
+            // Stateful SGR: the foreground set by the last escape stays active across
+            // runs, so only real colour changes are emitted. Blanks (glyph 0 in every
+            // charset) show no foreground and neither need nor break the colour.
+            if (glyph == 0) {
+                while (x < count && glyphs[x] == 0) ++x;
+                blank_run(x - run_start, line_end && x == count);
+                continue;
+            }
+            const uint32_t color = colors[run_start];
+            while (x < count && glyphs[x] == glyph && colors[x] == color) ++x;
+            if (color != sgr.fg) {
+                out.template escape<Depth>(color);
+                sgr.fg = color;
+            }
+        } else {
+            while (x < count && glyphs[x] == glyph) ++x;
+            if (glyph == 0) {
+                blank_run(x - run_start, line_end && x == count);
+                continue;
+            }
+        }
+        glyph_run(glyph_text[glyph], x - run_start);
+    }
+}
+
+// ---- palette quantization for 256 / 16 colour output ----
+
+constexpr uint8_t kBayer4[4][4] = {
+    {0, 8, 2, 10},
+    {12, 4, 14, 6},
+    {3, 11, 1, 9},
+    {15, 7, 13, 5},
+};
+
+// ordered tone dither: 64 thresholds, added in 1/64 glyph steps before truncating
+constexpr uint8_t kBayer8[8][8] = {
+    {0, 32, 8, 40, 2, 34, 10, 42},
+    {48, 16, 56, 24, 50, 18, 58, 26},
+    {12, 44, 4, 36, 14, 46, 6, 38},
+    {60, 28, 52, 20, 62, 30, 54, 22},
+    {3, 35, 11, 43, 1, 33, 9, 41},
+    {51, 19, 59, 27, 49, 17, 57, 25},
+    {15, 47, 7, 39, 13, 45, 5, 37},
+    {63, 31, 55, 23, 61, 29, 53, 21},
+};
+
+// xterm's default 16-colour palette
+constexpr uint8_t kAnsi16Palette[16][3] = {
+    {0, 0, 0}, {205, 0, 0}, {0, 205, 0}, {205, 205, 0}, {0, 0, 238}, {205, 0, 205}, {0, 205, 205}, {229, 229, 229},
+    {127, 127, 127}, {255, 0, 0}, {0, 255, 0}, {255, 255, 0}, {92, 92, 255}, {255, 0, 255}, {0, 255, 255}, {255, 255, 255},
+};
+
+constexpr uint8_t kCubeLevels[6] = {0, 95, 135, 175, 215, 255};
+
+inline int color_distance(int r0, int g0, int b0, int r1, int g1, int b1) {
+    // cheap perceptual weighting (green matters most, blue least)
+    const int dr = r0 - r1, dg = g0 - g1, db = b0 - b1;
+    return 2 * dr * dr + 4 * dg * dg + 3 * db * db;
+}
+
+int nearest_cube_level(int v) {
+    int best = 0;
+    for (int i = 1; i < 6; ++i) {
+        if (std::abs(kCubeLevels[i] - v) < std::abs(kCubeLevels[best] - v)) best = i;
+    }
+    return best;
+}
+
+// 32x32x32 RGB -> palette index table. ANSI256 only uses entries 16..255 (the
+// 6x6x6 cube and the grey ramp), since 0..15 change with the terminal theme.
+std::vector<uint8_t> build_palette_lut(ColorDepth depth) {
+    std::vector<uint8_t> lut(32 * 32 * 32);
+    for (int i = 0; i < 32 * 32 * 32; ++i) {
+        // sample the centre of each 8-wide bucket
+        const int r = ((i >> 10) << 3) | 4, g = (((i >> 5) & 31) << 3) | 4, b = ((i & 31) << 3) | 4;
+        int best = 0;
+        if (depth == ColorDepth::ANSI16) {
+            int best_d = -1;
+            for (int c = 0; c < 16; ++c) {
+                int d = color_distance(r, g, b, kAnsi16Palette[c][0], kAnsi16Palette[c][1], kAnsi16Palette[c][2]);
+                if (best_d < 0 || d < best_d) { best_d = d; best = c; }
+            }
+        } else {
+            // closest cube entry is per channel; the only other candidate is the nearest grey
+            const int cr = nearest_cube_level(r), cg = nearest_cube_level(g), cb = nearest_cube_level(b);
+            const int cube_d = color_distance(r, g, b, kCubeLevels[cr], kCubeLevels[cg], kCubeLevels[cb]);
+            const int grey = std::clamp(((r + g + b) / 3 - 3) / 10, 0, 23);
+            const int gv = 8 + grey * 10;
+            const int grey_d = color_distance(r, g, b, gv, gv, gv);
+            best = grey_d < cube_d ? 232 + grey : 16 + cr * 36 + cg * 6 + cb;
+        }
+        lut[i] = static_cast<uint8_t>(best);
+    }
+    return lut;
+}
+
+const uint8_t* palette_lut(ColorDepth depth) {
+    static const std::vector<uint8_t> ansi256 = build_palette_lut(ColorDepth::ANSI256);
+    static const std::vector<uint8_t> ansi16 = build_palette_lut(ColorDepth::ANSI16);
+    return depth == ColorDepth::ANSI16 ? ansi16.data() : ansi256.data();
+}
+
+// palette index -> 0xRRGGBB, matching what the terminal (roughly) shows
+uint32_t palette_rgb(ColorDepth depth, uint32_t index) {
+    int r, g, b;
+    if (depth == ColorDepth::ANSI16 || index < 16) {
+        r = kAnsi16Palette[index & 15][0];
+        g = kAnsi16Palette[index & 15][1];
+        b = kAnsi16Palette[index & 15][2];
+    } else if (index < 232) {
+        r = kCubeLevels[(index - 16) / 36];
+        g = kCubeLevels[(index - 16) / 6 % 6];
+        b = kCubeLevels[(index - 16) % 6];
+    } else {
+        r = g = b = 8 + static_cast<int>(index - 232) * 10;
+    }
+    return (uint32_t(r) << 16) | (uint32_t(g) << 8) | uint32_t(b);
+}
+
+// ---- perceptual colour distance for run merging ----
+
+constexpr int kLabScale = 16;  // Lab stored as int16 in 1/16 units
+
+// CIELAB (D65) for every 5-bit-per-channel RGB bucket, so a Delta E is three
+// lookups and a few integer ops instead of pow/cbrt per cell
+std::vector<int16_t> build_lab_lut() {
+    auto linear = [](float c) {
+        c /= 255.0f;
+        return c <= 0.04045f ? c / 12.92f : std::pow((c + 0.055f) / 1.055f, 2.4f);
+    };
+    auto f = [](float t) {
+        return t > 0.008856f ? std::cbrt(t) : 7.787f * t + 16.0f / 116.0f;
+    };
+    std::vector<int16_t> lut(32 * 32 * 32 * 3);
+    for (int i = 0; i < 32 * 32 * 32; ++i) {
+        const float r = linear(static_cast<float>(((i >> 10) << 3) | 4));
+        const float g = linear(static_cast<float>((((i >> 5) & 31) << 3) | 4));
+        const float b = linear(static_cast<float>(((i & 31) << 3) | 4));
+        const float fx = f((0.4124f * r + 0.3576f * g + 0.1805f * b) / 0.95047f);
+        const float fy = f(0.2126f * r + 0.7152f * g + 0.0722f * b);
+        const float fz = f((0.0193f * r + 0.1192f * g + 0.9505f * b) / 1.08883f);
+        lut[i * 3] = static_cast<int16_t>(std::lround((116.0f * fy - 16.0f) * kLabScale));
+        lut[i * 3 + 1] = static_cast<int16_t>(std::lround(500.0f * (fx - fy) * kLabScale));
+        lut[i * 3 + 2] = static_cast<int16_t>(std::lround(200.0f * (fy - fz) * kLabScale));
+    }
+    return lut;
+}
+
+inline const int16_t* lab_of(uint32_t rgb) {
+    static const std::vector<int16_t> lut = build_lab_lut();
+    const uint32_t index = ((rgb >> 9) & 0x7c00) | ((rgb >> 6) & 0x3e0) | ((rgb >> 3) & 0x1f);
+    return lut.data() + index * 3;
+}
+
+// squared CIE76 Delta E, in kLabScale^2 units
+inline int lab_distance2(const int16_t* a, const int16_t* b) {
+    const int dl = a[0] - b[0], da = a[1] - b[1], db = a[2] - b[2];
+    return dl * dl + da * da + db * db;
+}
+
+// rate control ladder for Config::frame_byte_budget. each step drops more truecolor
+// bits and widens the run tolerance; the step that fitted carries over to the next frame
+struct QualityStep {
+    int drop_bits;    // low bits rounded away per truecolor channel
+    float tolerance;  // minimum run-merge Delta E
+};
+constexpr QualityStep kQualitySteps[] = {{0, 0.0f}, {1, 2.0f}, {2, 4.0f}, {3, 6.0f}, {4, 10.0f}, {5, 16.0f}, {6, 25.0f}};
+constexpr int kMaxQualityLevel = static_cast<int>(std::size(kQualitySteps)) - 1;
+// frames below 3/4 of the budget this many times in a row win back one step
+constexpr int kQualityRecoverFrames = 8;
+
+// BRAILLE dot thresholds per [sample row][sample column & 3]: plain midpoint, or the
+// 4x4 Bayer matrix spread over the tone range
+constexpr uint8_t kBrailleFlat[4][4] = {{128, 128, 128, 128}, {128, 128, 128, 128},
+                                        {128, 128, 128, 128}, {128, 128, 128, 128}};
+constexpr uint8_t kBrailleBayer[4][4] = {{8, 136, 40, 168}, {200, 72, 232, 104},
+                                         {56, 184, 24, 152}, {248, 120, 216, 88}};
+
+// source samples behind each cell: sub-cell modes resample the image at a multiple
+// of the cell grid and build each cell from its block of samples
+struct CellLayout {
+    int cols;
+    int rows;
+};
+
+CellLayout cell_layout(Mode mode) {
+    switch (mode) {
+        case Mode::HALF_BLOCK: return {1, 2};
+        case Mode::BRAILLE: return {2, 4};
+        case Mode::QUADRANT: return {2, 2};
+        case Mode::SEXTANT: return {2, 3};
+        case Mode::EDGE: return {3, 3};
+        case Mode::SHAPE: return {4, 8};
+        default: return {1, 1};
+    }
+}
+
+} // namespace
+
+// ---- persistent worker pool used to split convert() into row bands ----
+
+class ThreadPool {
+public:
+    explicit ThreadPool(int threads) {
+        for (int i = 1; i < threads; ++i) workers_.emplace_back([this] { worker_loop(); });
+    }
+
+    ~ThreadPool() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            stop_ = true;
+        }
+        wake_.notify_all();
+        for (auto& t : workers_) t.join();
+    }
+
+    // workers plus the calling thread
+    int size() const { return static_cast<int>(workers_.size()) + 1; }
+
+    // runs fn(0..tasks-1) on the pool, the caller helps out and returns once all tasks are done.
+    // fn is only borrowed for the call, so no std::function (and no allocation) per frame
+    template <typename Fn>
+    void run(int tasks, const Fn& fn) {
+        run_erased(tasks, [](const void* ctx, int task) { (*static_cast<const Fn*>(ctx))(task); }, &fn);
+    }
+
+private:
+    using TaskFn = void (*)(const void* ctx, int task);
+
+    void run_erased(int tasks, TaskFn call, const void* ctx) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            call_ = call;
+            ctx_ = ctx;
+            tasks_ = tasks;
+            next_ = 0;
+            pending_ = tasks;
+            ++generation_;
+        }
+        wake_.notify_all();
+        drain();
+        std::unique_lock<std::mutex> lock(mutex_);
+        done_.wait(lock, [this] { return pending_ == 0; });
+        call_ = nullptr;
+    }
+
+    void drain() {
+        for (;;) {
+            TaskFn call;
+            const void* ctx;
+            int task;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (!call_ || next_ >= tasks_) return;
+                call = call_;
+                ctx = ctx_;
+                task = next_++;
+            }
+            call(ctx, task);
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (--pending_ == 0) done_.notify_all();
+        }
+    }
+
+    void worker_loop() {
+        uint64_t seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                wake_.wait(lock, [&] { return stop_ || generation_ != seen; });
+                if (stop_) return;
+                seen = generation_;
+            }
+            drain();
+        }
+    }
+
+    std::vector<std::thread> workers_;
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::condition_variable done_;
+    TaskFn call_ = nullptr;
+    const void* ctx_ = nullptr;
+    int tasks_ = 0;
+    int next_ = 0;
+    int pending_ = 0;
+    uint64_t generation_ = 0;
+    bool stop_ = false;
+};
+
+Interpreter::Interpreter(const Config& config) : config_(config) {
+    rebuild_tone_lut();
+    set_threads(config.threads);
+}
+
+Interpreter::~Interpreter() = default;
+Interpreter::Interpreter(const Interpreter& other) : Interpreter(other.config_) {}
+
+Interpreter& Interpreter::operator=(const Interpreter& other) {
+    if (this != &other) *this = Interpreter(other.config_);
+    return *this;
+}
+
+Interpreter::Interpreter(Interpreter&&) noexcept = default;
+Interpreter& Interpreter::operator=(Interpreter&&) noexcept = default;
+
+int Interpreter::row_band_count(int rows) const {
+    if (rows <= 0) return 0;
+    // error diffusion carries state from row to row, so it gets a single band
+    if (!pool_ || rows < 2 || config_.tone_dither == ToneDither::FLOYD_STEINBERG) return 1;
+    // a few bands per thread so uneven rows (long colour runs vs flat) still balance out
+    return std::min(rows, pool_->size() * 4);
+}
+
+template <typename Fn>
+void Interpreter::for_each_row_band(int rows, const Fn& fn) {
+    const int bands = row_band_count(rows);
+    if (bands == 1) {
+        fn(0, 0, rows);
+    } else if (bands > 1) {
+        pool_->run(bands, [&](int band) {
+            fn(band, static_cast<int>(int64_t(rows) * band / bands), static_cast<int>(int64_t(rows) * (band + 1) / bands));
+        });
+    }
+}
 
 std::string Interpreter::convert(const Image& image) {
+    std::string result;
+    convert_into(image, result);
+    return result;
+}
+
+void Interpreter::convert_into(const Image& image, std::string& out) {
+    convert_impl(image, out, false);
+}
+
+void Interpreter::convert_delta(const Image& image, std::string& out) {
+    convert_impl(image, out, true);
+}
+
+void Interpreter::reset_delta() {
+    prev_width_ = -1;
+    prev_height_ = -1;
+    held_width_ = -1;
+    held_height_ = -1;
+}
+
+void Interpreter::convert_cells(const Image& image, CellGrid& grid) {
+    const SamplePlan& plan = frame_plan(image);
+    const CellLayout layout = cell_layout(config_.mode);
+    const int target_width = plan.width / layout.cols;
+    const int target_height = plan.height / layout.rows;
+    const SampleRowFn sample = row_sampler(plan.filter, image.channels);
+    const bool color = config_.use_color;
+
+    // the tone/colour half of convert(): sample into the cell planes, then hand them over.
+    // swapping leaves the grid's old planes behind as scratch, so nothing is copied
+    const size_t cells = static_cast<size_t>(target_width) * std::max(target_height, 0);
+    const size_t cell_samples = static_cast<size_t>(plan.width) * layout.rows;
+    const int bands = row_band_count(target_height);
+    glyphs_.resize(cells);
+    colors_.resize(color ? cells : 0);
+    backgrounds_.resize(color && two_color_mode() ? cells : 0);
+    row_rgb_.resize(bands * cell_samples * 3);
+    const size_t tone_size = cell_samples + static_cast<size_t>(target_width) * 6;
+    row_tone_.resize(bands * tone_size);
+    const size_t acc_size = band_accumulator_size(image);
+    row_acc_.resize(bands * acc_size);
+    const size_t lerp_size = band_lerp_size(plan.width);
+    row_lerp_.resize(bands * lerp_size);
+    hold_colors_ = false;  // grids are independent snapshots, no hysteresis
+    for_each_row_band(target_height, [&](int band, int y0, int y1) {
+        uint8_t* rgb = row_rgb_.data() + band * cell_samples * 3;
+        uint8_t* tone = row_tone_.data() + band * tone_size;
+        uint32_t* acc = row_acc_.data() + band * acc_size;
+        uint16_t* lerp = row_lerp_.data() + band * lerp_size;
+        for (int y = y0; y < y1; ++y) {
+            for (int k = 0; k < layout.rows; ++k) {
+                (this->*sample)(image, plan, y * layout.rows + k, rgb + static_cast<size_t>(k) * plan.width * 3, acc, lerp);
+            }
+            if (color) {
+                map_row<true, ColorDepth::TRUECOLOR>(y, target_width, rgb, tone, 0);
+            } else {
+                map_row<false, ColorDepth::TRUECOLOR>(y, target_width, rgb, tone, 0);
+            }
+        }
+    });
+
+    grid.width = target_width;
+    grid.height = std::max(target_height, 0);
+    grid.mode = config_.mode;
+    glyphs_.swap(grid.glyphs);
+    colors_.swap(grid.colors);
+    backgrounds_.swap(grid.backgrounds);
+}
+
+const Interpreter::SamplePlan& Interpreter::frame_plan(const Image& image) {
     if (image.data.empty() || image.width <= 0 || image.height <= 0) {
         throw std::invalid_argument("Invalid image data");
     }
@@ -23,86 +1272,673 @@ std::string Interpreter::convert(const Image& image) {
         target_height = static_cast<int>(target_width * image.height * config_.char_aspect_ratio / image.width);
     }
     
-    Image processed_image = resize_image(image, target_width, target_height);
-    
-    // Process image (im not doing dithering now because ughghhggg)
+    // row/column sampling tables, cached across frames of the same geometry.
+    // sub-cell modes sample a proportionally finer grid
+    const CellLayout layout = cell_layout(config_.mode);
+    return sampling_plan(image, target_width * layout.cols, std::max(target_height, 0) * layout.rows);
+}
 
-    std::string result;
-    // Reserve an estimated capacity when colored escapes add bytes per character
-    result.reserve(static_cast<size_t>(target_height) * (target_width * (config_.use_color ? 8 : 1) + 1));
-
-    // cached charset may be accessed via map_intensity_to_char()
-    auto& color_cache = color_escape_cache_;
-
-    for (int y = 0; y < target_height; ++y) {
-        int x = 0;
-        while (x < target_width) {
-            // compute properties of first pixel in run
-            uint8_t r = 0, g = 0, b = 0;
-            float luminance;
-            if (processed_image.channels >= 3) {
-                r = get_pixel_value(processed_image, x, y, 0);
-                g = get_pixel_value(processed_image, x, y, 1);
-                b = get_pixel_value(processed_image, x, y, 2);
-                luminance = get_luminance(r, g, b);
-            } else {
-                luminance = get_pixel_value(processed_image, x, y, 0) / 255.0f;
-                r = g = b = static_cast<uint8_t>(luminance * 255.0f);
-            }
-            if (config_.use_gamma_correction) luminance = apply_gamma_correction(luminance);
-            luminance = std::clamp(luminance * config_.contrast + config_.brightness, 0.0f, 1.0f);
-            luminance = apply_perceptual_mapping(luminance);
+void Interpreter::convert_impl(const Image& image, std::string& out, bool delta) {
+    const SamplePlan& plan = frame_plan(image);
+
+    // everything that depends on Config is resolved here, once per frame, so the
+    // per-pixel loops run without branches on mode/colour/channels
+    if (!config_.use_color) {
+        convert_frame<false, ColorDepth::TRUECOLOR>(image, plan, out, delta);
+        return;
+    }
+    switch (config_.color_depth) {
+        case ColorDepth::TRUECOLOR: convert_frame<true, ColorDepth::TRUECOLOR>(image, plan, out, delta); break;
+        case ColorDepth::ANSI256: convert_frame<true, ColorDepth::ANSI256>(image, plan, out, delta); break;
+        case ColorDepth::ANSI16: convert_frame<true, ColorDepth::ANSI16>(image, plan, out, delta); break;
+    }
+}
 
-            const std::string& ch = map_intensity_to_char(luminance);
+template <bool Color, ColorDepth Depth>
+void Interpreter::convert_frame(const Image& image, const SamplePlan& plan, std::string& out, bool delta) {
+    const CellLayout layout = cell_layout(config_.mode);
+    const int target_width = plan.width / layout.cols;
+    const int target_height = plan.height / layout.rows;
+    const SampleRowFn sample = row_sampler(plan.filter, image.channels);
+    const Charset charset = get_charset();
 
-            // extend run while glyph and color match (this is ripped lol)
-            int run_start = x;
-            ++x;
-            while (x < target_width) {
-                uint8_t nr = 0, ng = 0, nb = 0;
-                float nl;
-                if (processed_image.channels >= 3) {
-                    nr = get_pixel_value(processed_image, x, y, 0);
-                    ng = get_pixel_value(processed_image, x, y, 1);
-                    nb = get_pixel_value(processed_image, x, y, 2);
-                    nl = get_luminance(nr, ng, nb);
-                } else {
-                    nl = get_pixel_value(processed_image, x, y, 0) / 255.0f;
-                    nr = ng = nb = static_cast<uint8_t>(nl * 255.0f);
+    // pass 1: sample every row straight from the source into cells and measure its
+    // encoded size. all scratch lives in members, so same-sized frames reuse their capacity
+    const size_t cells = static_cast<size_t>(target_width) * std::max(target_height, 0);
+    const size_t cell_samples = static_cast<size_t>(plan.width) * layout.rows;  // per cell row
+    const int bands = row_band_count(target_height);
+    const size_t budget = Color ? config_.frame_byte_budget : 0;
+    const bool two_color = Color && two_color_mode();
+    glyphs_.resize(cells);
+    colors_.resize(Color ? cells : 0);
+    backgrounds_.resize(two_color ? cells : 0);
+    row_offsets_.assign(std::max(target_height, 0) + 1, 0);
+    // under a budget the whole frame's samples are kept so a coarser step can be
+    // re-measured without touching the source again
+    row_rgb_.resize((budget ? std::max(target_height, 0) : bands) * cell_samples * 3);
+    // tones of every sample plus two cell-resolution RGB rows (mean / 2-means colours)
+    const size_t tone_size = cell_samples + static_cast<size_t>(target_width) * 6;
+    row_tone_.resize(bands * tone_size);
+    const size_t acc_size = band_accumulator_size(image);
+    row_acc_.resize(bands * acc_size);
+    const size_t lerp_size = band_lerp_size(plan.width);
+    row_lerp_.resize(bands * lerp_size);
+    // hysteresis compares against the previous frame, when there is one of this size
+    const bool hysteresis = config_.tone_hysteresis > 0.0f || (Color && config_.color_hysteresis > 0.0f);
+    const bool hold = hysteresis && held_width_ == target_width && held_height_ == target_height;
+    const bool ramp = config_.mode == Mode::CLEAN || config_.mode == Mode::HIGH_FIDELITY || config_.mode == Mode::BLOCK;
+    const bool hold_tone = hold && ramp && config_.tone_hysteresis > 0.0f;
+    hold_colors_ = hold && Color && config_.color_hysteresis > 0.0f && held_colors_.size() == cells &&
+                   held_backgrounds_.size() == backgrounds_.size();
+
+    auto measure_rows = [&](int level, bool resample) {
+        const QualityStep& step = kQualitySteps[level];
+        const float tolerance = std::max(config_.color_tolerance, step.tolerance) * kLabScale;
+        const int merge_distance2 = Color && tolerance > 0.0f ? static_cast<int>(tolerance * tolerance) : 0;
+        row_unmerged_.resize(merge_distance2 > 0 ? std::max(target_height, 0) : 0);
+        for_each_row_band(target_height, [&](int band, int y0, int y1) {
+            uint32_t* acc = row_acc_.data() + band * acc_size;
+            uint16_t* lerp = row_lerp_.data() + band * lerp_size;
+            uint8_t* tone = row_tone_.data() + band * tone_size;
+            for (int y = y0; y < y1; ++y) {
+                uint8_t* rgb = row_rgb_.data() + (budget ? y : band) * cell_samples * 3;
+                for (int k = 0; resample && k < layout.rows; ++k) {
+                    (this->*sample)(image, plan, y * layout.rows + k, rgb + static_cast<size_t>(k) * plan.width * 3, acc, lerp);
                 }
-                if (config_.use_gamma_correction) nl = apply_gamma_correction(nl);
-                nl = std::clamp(nl * config_.contrast + config_.brightness, 0.0f, 1.0f);
-                nl = apply_perceptual_mapping(nl);
-                const std::string& nch = map_intensity_to_char(nl);
-                if (config_.use_color) {
-                    if (nr != r || ng != g || nb != b || nch != ch) break;
-                } else {
-                    if (nch != ch) break;
+                map_row<Color, Depth>(y, target_width, rgb, tone, step.drop_bits);
+                if (hold_tone) hold_tone_row(y, target_width, rgb, tone);
+                ByteCounter counter;
+                encode_row<Color, Depth>(counter, charset, y, target_width);
+                if (Color && merge_distance2 > 0) {
+                    // measure exact colours first so stats can report what merging saved
+                    row_unmerged_[y] = counter.size;
+                    merge_row_colors<Depth>(y, target_width, merge_distance2);
+                    counter = ByteCounter{};
+                    encode_row<Color, Depth>(counter, charset, y, target_width);
                 }
-                ++x;
+                row_offsets_[y + 1] = counter.size;
+            }
+        });
+        // prefix sum turns row sizes into row offsets inside the final frame
+        for (size_t y = 1; y < row_offsets_.size(); ++y) row_offsets_[y] += row_offsets_[y - 1];
+    };
+
+    // convert_delta(): when the terminal still shows our previous frame at this size,
+    // the changed cells are measured too and whichever encoding is smaller gets sent.
+    // a full redraw is prefixed with cursor home, and with a screen clear when it
+    // replaces a frame of another size
+    const bool diff = delta && prev_width_ == target_width && prev_height_ == target_height;
+    const bool resized = delta && !diff && prev_width_ >= 0;
+    const std::string_view home = !delta ? "" : resized ? "\x1b[2J\x1b[H" : "\x1b[H";
+    auto measure_delta = [&] {
+        delta_offsets_.assign(std::max(target_height, 0) + 1, 0);
+        for_each_row_band(target_height, [&](int, int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                ByteCounter counter;
+                encode_row_delta<Color, Depth>(counter, charset, y, target_width);
+                delta_offsets_[y + 1] = counter.size;
             }
+        });
+        for (size_t y = 1; y < delta_offsets_.size(); ++y) delta_offsets_[y] += delta_offsets_[y - 1];
+    };
+    auto frame_size = [&] {
+        if (!diff) return row_offsets_.back() + home.size();
+        measure_delta();
+        return std::min(delta_offsets_.back(), row_offsets_.back() + home.size());
+    };
 
-            int run_len = x - run_start;
+    int level = budget ? quality_level_ : 0;
+    measure_rows(level, true);
+    size_t size = frame_size();
+    if (budget) {
+        // step down until the frame fits (or the ladder runs out), then remember the
+        // step so steady playback settles after one pass per frame
+        while (size > budget && level < kMaxQualityLevel) {
+            measure_rows(++level, false);
+            size = frame_size();
+        }
+        quality_level_ = level;
+        if (size * 4 < budget * 3 && level > 0) {
+            if (++headroom_frames_ >= kQualityRecoverFrames) {
+                headroom_frames_ = 0;
+                --quality_level_;
+            }
+        } else {
+            headroom_frames_ = 0;
+        }
+    }
+    const bool use_diff = diff && delta_offsets_.back() < row_offsets_.back() + home.size();
 
-            if (config_.use_color) {
-                uint32_t key = (uint32_t(r) << 16) | (uint32_t(g) << 8) | uint32_t(b);
-                auto it = color_cache.find(key);
-                if (it == color_cache.end()) {
-                    char buf[32];
-                    std::snprintf(buf, sizeof(buf), "\x1b[38;2;%u;%u;%um", r, g, b);
-                    it = color_cache.emplace(key, std::string(buf)).first;
-                }
-                result += it->second;
-                for (int i = 0; i < run_len; ++i) result += ch;
-                result += "\x1b[0m";
+    stats_.bytes = size;
+    stats_.bytes_unmerged = row_offsets_.back() + home.size();
+    stats_.quality_level = level;
+    stats_.delta = use_diff;
+    if (!row_unmerged_.empty()) {
+        stats_.bytes_unmerged = home.size();
+        for (size_t bytes : row_unmerged_) stats_.bytes_unmerged += bytes;
+    }
+
+    // pass 2: each band encodes straight into its slice, nothing gets concatenated.
+    // resize() keeps out's capacity, so a reused buffer stops allocating after the first frame
+    if (use_diff) {
+        out.resize(delta_offsets_.back());
+        char* frame = &out[0];
+        for_each_row_band(target_height, [&](int, int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                ByteWriter writer{frame + delta_offsets_[y]};
+                encode_row_delta<Color, Depth>(writer, charset, y, target_width);
+            }
+        });
+    } else {
+        out.resize(home.size() + row_offsets_.back());
+        char* frame = &out[0];
+        std::memcpy(frame, home.data(), home.size());
+        frame += home.size();
+        for_each_row_band(target_height, [&](int, int y0, int y1) {
+            for (int y = y0; y < y1; ++y) {
+                ByteWriter writer{frame + row_offsets_[y]};
+                encode_row<Color, Depth>(writer, charset, y, target_width);
+            }
+        });
+    }
+
+    if (hysteresis) {
+        held_glyphs_ = glyphs_;
+        held_colors_ = colors_;
+        held_backgrounds_ = backgrounds_;
+        held_width_ = target_width;
+        held_height_ = target_height;
+    }
+    if (delta) {
+        // what the terminal shows now is the base for the next diff; swapping keeps both capacities
+        glyphs_.swap(shown_glyphs_);
+        colors_.swap(shown_colors_);
+        backgrounds_.swap(shown_backgrounds_);
+        prev_width_ = target_width;
+        prev_height_ = target_height;
+    }
+}
+
+void Interpreter::convert_to(const Image& image, Sink& sink) {
+    convert_into(image, frame_);
+    sink.write(frame_);
+}
+
+const Interpreter::SamplePlan& Interpreter::sampling_plan(const Image& image, int width, int height) {
+    SamplePlan& plan = plan_;
+    if (plan.src_width == image.width && plan.src_height == image.height && plan.channels == image.channels &&
+        plan.width == width && plan.height == height && plan.filter == config_.filter) {
+        return plan;
+    }
+    // geometry changed (first frame, new size or filter): rebuild every table once
+    plan.src_width = image.width;
+    plan.src_height = image.height;
+    plan.channels = image.channels;
+    plan.width = width;
+    plan.height = height;
+    plan.filter = config_.filter;
+
+    const int channels = image.channels;
+    const size_t stride = static_cast<size_t>(image.width) * channels;
+    plan.col_offset.assign(std::max(width, 0), 0);
+    plan.col_extent.assign(std::max(width, 0), 0);
+    plan.row_offset.assign(std::max(height, 0), 0);
+    plan.row_extent.assign(std::max(height, 0), 0);
+    switch (config_.filter) {
+        case Filter::NEAREST: {
+            const float x_ratio = static_cast<float>(image.width) / width;
+            for (int x = 0; x < width; ++x) {
+                plan.col_offset[x] = std::clamp(static_cast<int>(x * x_ratio), 0, image.width - 1) * channels;
+            }
+            const float y_ratio = static_cast<float>(image.height) / height;
+            for (int y = 0; y < height; ++y) {
+                plan.row_offset[y] = std::clamp(static_cast<int>(y * y_ratio), 0, image.height - 1) * stride;
+            }
+            break;
+        }
+        case Filter::BOX:
+            // source columns/rows [first, first + extent) land in each cell; at least one when upscaling
+            for (int x = 0; x < width; ++x) {
+                int x0 = static_cast<int>(int64_t(x) * image.width / width);
+                int x1 = static_cast<int>(int64_t(x + 1) * image.width / width);
+                x0 = std::min(x0, image.width - 1);
+                plan.col_offset[x] = x0 * channels;
+                plan.col_extent[x] = std::max(x1 - x0, 1);
+            }
+            for (int y = 0; y < height; ++y) {
+                int y0 = static_cast<int>(int64_t(y) * image.height / height);
+                int y1 = static_cast<int>(int64_t(y + 1) * image.height / height);
+                y0 = std::min(y0, image.height - 1);
+                plan.row_offset[y] = y0 * stride;
+                plan.row_extent[y] = std::max(y1 - y0, 1);
+            }
+            break;
+        case Filter::BILINEAR:
+            // pixel-centre aligned; extent holds the 8-bit weight of the right/lower neighbour
+            for (int x = 0; x < width; ++x) {
+                float fx = std::clamp((x + 0.5f) * image.width / width - 0.5f, 0.0f, static_cast<float>(image.width - 1));
+                int x0 = static_cast<int>(fx);
+                plan.col_offset[x] = x0 * channels;
+                plan.col_extent[x] = x0 + 1 < image.width ? static_cast<int>((fx - x0) * 256.0f) : 0;
+            }
+            for (int y = 0; y < height; ++y) {
+                float fy = std::clamp((y + 0.5f) * image.height / height - 0.5f, 0.0f, static_cast<float>(image.height - 1));
+                int y0 = static_cast<int>(fy);
+                plan.row_offset[y] = y0 * stride;
+                plan.row_extent[y] = y0 + 1 < image.height ? static_cast<int>((fy - y0) * 256.0f) : 0;
+            }
+            break;
+    }
+    return plan;
+}
+
+size_t Interpreter::band_accumulator_size(const Image& image) const {
+    return config_.filter == Filter::BOX ? static_cast<size_t>(image.width) * image.channels : 0;
+}
+
+size_t Interpreter::band_lerp_size(int width) const {
+    // two horizontally filtered rows plus the blended one
+    return config_.filter == Filter::BILINEAR ? static_cast<size_t>(width) * 3 * 3 : 0;
+}
+
+template <Filter F, int Channels>
+void Interpreter::sample_row(const Image& image, const SamplePlan& plan, int y, uint8_t* rgb, uint32_t* acc,
+                             uint16_t* lerp) const {
+    const int width = plan.width;
+    // fixed channel counts let the gathers below compile to straight loads
+    const int channels = Channels ? Channels : image.channels;
+    const size_t stride = static_cast<size_t>(image.width) * channels;
+    const uint8_t* src = image.data.data() + plan.row_offset[y];
+    const int* col_offset = plan.col_offset.data();
+    const int* col_extent = plan.col_extent.data();
+    // channel indices for r/g/b so grey widens and alpha is dropped
+    const int cg = channels >= 3 ? 1 : 0;
+    const int cb = channels >= 3 ? 2 : 0;
+
+    if constexpr (F == Filter::NEAREST) {
+        for (int x = 0; x < width; ++x) {
+            const uint8_t* px = src + col_offset[x];
+            rgb[x * 3] = px[0];
+            rgb[x * 3 + 1] = px[cg];
+            rgb[x * 3 + 2] = px[cb];
+        }
+    } else if constexpr (F == Filter::BOX) {
+        // vertical pass: sum the covered source rows
+        const int rows = plan.row_extent[y];
+        std::fill(acc, acc + stride, 0u);
+        for (int r = 0; r < rows; ++r) {
+            accumulate_row(acc, src + r * stride, static_cast<int>(stride));
+        }
+        // horizontal pass: average each cell's column span. left scalar: it reads one accumulated
+        // row per output row while the pass above reads every covered source row, and the spans
+        // vary in width so they don't line up with vector lanes
+        for (int x = 0; x < width; ++x) {
+            const uint32_t* a = acc + col_offset[x];
+            const uint32_t area = static_cast<uint32_t>(rows) * static_cast<uint32_t>(col_extent[x]);
+            uint32_t sum[3] = {0, 0, 0};
+            for (int i = 0; i < col_extent[x]; ++i, a += channels) {
+                sum[0] += a[0];
+                sum[1] += a[cg];
+                sum[2] += a[cb];
+            }
+            for (int c = 0; c < 3; ++c) rgb[x * 3 + c] = static_cast<uint8_t>((sum[c] + area / 2) / area);
+        }
+    } else {
+        const int wy = plan.row_extent[y];
+        uint16_t* top = lerp;
+        uint16_t* bottom = top + width * 3;
+        uint16_t* blended = bottom + width * 3;
+        // horizontal pass on the two source rows, then one vectorized vertical blend
+        for (int r = 0; r < 2; ++r) {
+            const uint8_t* row = src + (r && wy ? stride : 0);
+            uint16_t* out = r ? bottom : top;
+            for (int x = 0; x < width; ++x) {
+                const uint8_t* p0 = row + col_offset[x];
+                const int wx = col_extent[x];
+                const uint8_t* p1 = wx ? p0 + channels : p0;
+                out[x * 3] = static_cast<uint16_t>((p0[0] * (256 - wx) + p1[0] * wx + 128) >> 8);
+                out[x * 3 + 1] = static_cast<uint16_t>((p0[cg] * (256 - wx) + p1[cg] * wx + 128) >> 8);
+                out[x * 3 + 2] = static_cast<uint16_t>((p0[cb] * (256 - wx) + p1[cb] * wx + 128) >> 8);
+            }
+        }
+        blend_rows(blended, top, bottom, wy, width * 3);
+        for (int i = 0; i < width * 3; ++i) rgb[i] = static_cast<uint8_t>(blended[i]);
+    }
+}
+
+Interpreter::SampleRowFn Interpreter::row_sampler(Filter filter, int channels) {
+    // one instantiation per (filter, channel count), picked once per frame
+    static constexpr SampleRowFn table[3][5] = {
+        {&Interpreter::sample_row<Filter::NEAREST, 0>, &Interpreter::sample_row<Filter::NEAREST, 1>,
+         &Interpreter::sample_row<Filter::NEAREST, 2>, &Interpreter::sample_row<Filter::NEAREST, 3>,
+         &Interpreter::sample_row<Filter::NEAREST, 4>},
+        {&Interpreter::sample_row<Filter::BOX, 0>, &Interpreter::sample_row<Filter::BOX, 1>,
+         &Interpreter::sample_row<Filter::BOX, 2>, &Interpreter::sample_row<Filter::BOX, 3>,
+         &Interpreter::sample_row<Filter::BOX, 4>},
+        {&Interpreter::sample_row<Filter::BILINEAR, 0>, &Interpreter::sample_row<Filter::BILINEAR, 1>,
+         &Interpreter::sample_row<Filter::BILINEAR, 2>, &Interpreter::sample_row<Filter::BILINEAR, 3>,
+         &Interpreter::sample_row<Filter::BILINEAR, 4>},
+    };
+    return table[static_cast<int>(filter)][channels <= 4 ? channels : 0];
+}
+
+template <ColorDepth Depth>
+void Interpreter::quantize_row(const uint8_t* rgb, int width, int y, int drop_bits, uint32_t* colors,
+                               const uint32_t* held) const {
+    if constexpr (Depth == ColorDepth::TRUECOLOR) {
+        if (drop_bits == 0) {
+            for (int x = 0; x < width; ++x) {
+                colors[x] = (uint32_t(rgb[x * 3]) << 16) | (uint32_t(rgb[x * 3 + 1]) << 8) | uint32_t(rgb[x * 3 + 2]);
+            }
+        } else {
+            // rate control: round channels to fewer bits so neighbours collapse into equal runs
+            const int half = 1 << (drop_bits - 1);
+            const uint32_t mask = 0xffu << drop_bits & 0xffu;
+            auto coarse = [&](uint8_t v) { return std::min<uint32_t>(v + half, 255) & mask; };
+            for (int x = 0; x < width; ++x) {
+                colors[x] = (coarse(rgb[x * 3]) << 16) | (coarse(rgb[x * 3 + 1]) << 8) | coarse(rgb[x * 3 + 2]);
+            }
+        }
+    } else {
+        // palette modes store the palette index; a 5-bit-per-channel LUT replaces the nearest-colour search
+        const uint8_t* lut = palette_lut(Depth);
+        if (config_.color_dither) {
+            // ordered dither: nudge each channel by a Bayer threshold about one palette step wide
+            const int amplitude = Depth == ColorDepth::ANSI256 ? 40 : 96;
+            const uint8_t* bayer = kBayer4[y & 3];
+            for (int x = 0; x < width; ++x) {
+                const int d = (bayer[x & 3] * 2 - 15) * amplitude / 32;
+                const int r = std::clamp(rgb[x * 3] + d, 0, 255);
+                const int g = std::clamp(rgb[x * 3 + 1] + d, 0, 255);
+                const int b = std::clamp(rgb[x * 3 + 2] + d, 0, 255);
+                colors[x] = lut[((r >> 3) << 10) | ((g >> 3) << 5) | (b >> 3)];
+            }
+        } else {
+            for (int x = 0; x < width; ++x) {
+                colors[x] = lut[((rgb[x * 3] >> 3) << 10) | ((rgb[x * 3 + 1] >> 3) << 5) | (rgb[x * 3 + 2] >> 3)];
+            }
+        }
+    }
+    if (held) {
+        // colour hysteresis: last frame's colour stays unless the new one is closer to the
+        // sample by more than color_hysteresis (Delta E), so near-ties between palette
+        // entries or rounding steps don't flip back and forth every frame
+        const float band = config_.color_hysteresis * kLabScale;
+        auto lab_of_cell = [](uint32_t color) {
+            return lab_of(Depth == ColorDepth::TRUECOLOR ? color : palette_rgb(Depth, color));
+        };
+        for (int x = 0; x < width; ++x) {
+            if (colors[x] == held[x]) continue;
+            const int16_t* sample = lab_of((uint32_t(rgb[x * 3]) << 16) | (uint32_t(rgb[x * 3 + 1]) << 8) | rgb[x * 3 + 2]);
+            const float to_new = std::sqrt(static_cast<float>(lab_distance2(sample, lab_of_cell(colors[x]))));
+            const float to_held = std::sqrt(static_cast<float>(lab_distance2(sample, lab_of_cell(held[x]))));
+            if (to_held <= to_new + band) colors[x] = held[x];
+        }
+    }
+}
+
+template <bool Color, ColorDepth Depth>
+void Interpreter::map_row(int y, int width, const uint8_t* rgb, uint8_t* tone, int drop_bits) {
+    const size_t row = static_cast<size_t>(y) * width;
+    uint8_t* glyphs = glyphs_.data() + row;
+    // last frame's colours of this row while color_hysteresis is holding them
+    const uint32_t* held = hold_colors_ ? held_colors_.data() + row : nullptr;
+    const uint32_t* held_bg = hold_colors_ && !held_backgrounds_.empty() ? held_backgrounds_.data() + row : nullptr;
+    if (config_.mode == Mode::HALF_BLOCK) {
+        // two sample rows per cell, stored back to back in rgb
+        const uint8_t* bottom = rgb + static_cast<size_t>(width) * 3;
+        if constexpr (Color) {
+            // ▀ paints the upper pixel in the foreground over the lower one in the
+            // background; cells where both agree become a blank on that background
+            uint32_t* fg = colors_.data() + row;
+            uint32_t* bg = backgrounds_.data() + row;
+            quantize_row<Depth>(rgb, width, y * 2, drop_bits, fg, held);
+            quantize_row<Depth>(bottom, width, y * 2 + 1, drop_bits, bg, held_bg);
+            for (int x = 0; x < width; ++x) glyphs[x] = fg[x] != bg[x];
+        } else {
+            // both rows go through the SIMD tone kernel in one call (the tone table is a
+            // 0/1 threshold here), then upper | lower << 1 indexes " ▀▄█"
+            glyph_row_kernel()(rgb, width * 2, tone_lut_.data(), tone);
+            for (int x = 0; x < width; ++x) glyphs[x] = static_cast<uint8_t>(tone[x] | tone[width + x] << 1);
+        }
+        return;
+    }
+    if (config_.mode == Mode::QUADRANT || config_.mode == Mode::SEXTANT) {
+        const int rows = config_.mode == Mode::QUADRANT ? 2 : 3;
+        const size_t samples = static_cast<size_t>(width) * rows * 2;
+        if constexpr (Color) {
+            // per-cell 2-means over the samples' luma and RGB; the set masks index the glyphs
+            uint8_t* fg_rgb = tone + samples;
+            uint8_t* bg_rgb = fg_rgb + static_cast<size_t>(width) * 3;
+            glyph_row_kernel()(rgb, static_cast<int>(samples), kIdentityLut.data(), tone);
+            if (rows == 2) {
+                two_means_row<2>(rgb, tone, width, glyphs, fg_rgb, bg_rgb);
             } else {
-                for (int i = 0; i < run_len; ++i) result += ch;
+                two_means_row<3>(rgb, tone, width, glyphs, fg_rgb, bg_rgb);
+            }
+            uint32_t* fg = colors_.data() + row;
+            uint32_t* bg = backgrounds_.data() + row;
+            quantize_row<Depth>(fg_rgb, width, y, drop_bits, fg, held);
+            quantize_row<Depth>(bg_rgb, width, y, drop_bits, bg, held_bg);
+            // palette quantization can map both means to one entry: that is a plain background cell
+            for (int x = 0; x < width; ++x) glyphs[x] = fg[x] == bg[x] ? 0 : glyphs[x];
+        } else {
+            // monochrome: every sample thresholded on its own (0/1 tone table), bit i = sample i
+            glyph_row_kernel()(rgb, static_cast<int>(samples), tone_lut_.data(), tone);
+            const size_t stride = static_cast<size_t>(width) * 2;
+            for (int x = 0; x < width; ++x) {
+                unsigned mask = 0;
+                for (int i = 0; i < rows * 2; ++i) mask |= unsigned(tone[(i >> 1) * stride + x * 2 + (i & 1)]) << i;
+                glyphs[x] = static_cast<uint8_t>(mask);
+            }
+        }
+        return;
+    }
+    if (config_.mode == Mode::EDGE) {
+        const size_t samples = static_cast<size_t>(width) * 9;
+        glyph_row_kernel()(rgb, static_cast<int>(samples), kIdentityLut.data(), tone);
+        const int threshold = static_cast<int>(std::lround(std::clamp(config_.edge_threshold, 0.0f, 1.0f) * 1020.0f));
+        edge_row(tone, width, tone_lut_.data(), threshold, glyphs);
+        if constexpr (Color) {
+            // same 3x3 binomial blur as the tone, on RGB
+            uint8_t* mean = tone + samples;
+            const size_t stride = static_cast<size_t>(width) * 9;
+            for (int x = 0; x < width; ++x) {
+                for (int ch = 0; ch < 3; ++ch) {
+                    unsigned sum = 8;
+                    for (int r = 0; r < 3; ++r) {
+                        const uint8_t* p = rgb + r * stride + x * 9 + ch;
+                        sum += (p[0] + 2 * p[3] + p[6]) << (r == 1);
+                    }
+                    mean[x * 3 + ch] = static_cast<uint8_t>(sum >> 4);
+                }
+            }
+            quantize_row<Depth>(mean, width, y, drop_bits, colors_.data() + row, held);
+        }
+        return;
+    }
+    if (config_.mode == Mode::SHAPE) {
+        // coverage of all 32 samples per cell from the tone kernel, then matched by shape
+        const size_t samples = static_cast<size_t>(width) * 32;
+        glyph_row_kernel()(rgb, static_cast<int>(samples), tone_lut_.data(), tone);
+        match_shape_row(tone, width, glyphs);
+        if constexpr (Color) {
+            uint8_t* mean = tone + samples;
+            const size_t stride = static_cast<size_t>(width) * 12;
+            for (int x = 0; x < width; ++x) {
+                for (int ch = 0; ch < 3; ++ch) {
+                    unsigned sum = 16;
+                    for (int r = 0; r < 8; ++r) {
+                        const uint8_t* p = rgb + r * stride + x * 12 + ch;
+                        sum += p[0] + p[3] + p[6] + p[9];
+                    }
+                    mean[x * 3 + ch] = static_cast<uint8_t>(sum >> 5);
+                }
+            }
+            quantize_row<Depth>(mean, width, y, drop_bits, colors_.data() + row, held);
+        }
+        return;
+    }
+    if (config_.mode == Mode::BRAILLE) {
+        // all 8 samples per cell go through the tone kernel in one call, then get
+        // thresholded (optionally against a Bayer matrix) into dot bits
+        const size_t samples = static_cast<size_t>(width) * 8;
+        glyph_row_kernel()(rgb, static_cast<int>(samples), tone_lut_.data(), tone);
+        pack_braille_row(tone, width, config_.braille_dither ? kBrailleBayer : kBrailleFlat, glyphs);
+        if constexpr (Color) {
+            // dots are drawn in the cell's average colour, kept after the tones in the scratch row
+            uint8_t* mean = tone + samples;
+            const size_t stride = static_cast<size_t>(width) * 6;
+            for (int x = 0; x < width; ++x) {
+                for (int ch = 0; ch < 3; ++ch) {
+                    unsigned sum = 4;
+                    for (int r = 0; r < 4; ++r) sum += rgb[r * stride + x * 6 + ch] + rgb[r * stride + x * 6 + 3 + ch];
+                    mean[x * 3 + ch] = static_cast<uint8_t>(sum >> 3);
+                }
             }
+            quantize_row<Depth>(mean, width, y, drop_bits, colors_.data() + row, held);
+        }
+        return;
+    }
+    if constexpr (Color) quantize_row<Depth>(rgb, width, y, drop_bits, colors_.data() + row, held);
+    switch (config_.tone_dither) {
+        case ToneDither::NONE:
+            glyph_row_kernel()(rgb, width, tone_lut_.data(), glyphs);
+            break;
+        case ToneDither::BAYER: {
+            // luma through the SIMD kernel, then a position-only offset: no state between
+            // cells or rows, so bands stay independent and frames stay stable for delta output
+            glyph_row_kernel()(rgb, width, kIdentityLut.data(), tone);
+            const uint8_t* bayer = kBayer8[y & 7];
+            for (int x = 0; x < width; ++x) glyphs[x] = static_cast<uint8_t>((tone_fine_[tone[x]] + bayer[x & 7]) >> 6);
+            break;
         }
-        result += '\n';
+        case ToneDither::FLOYD_STEINBERG:
+            glyph_row_kernel()(rgb, width, kIdentityLut.data(), tone);
+            diffuse_tone_row(y, width, tone, glyphs);
+            break;
     }
+}
 
-    return result;
+void Interpreter::diffuse_tone_row(int y, int width, const uint8_t* luma, uint8_t* glyphs) {
+    // error in 1/64 glyph steps, this row's (carried from the previous one) and the next's,
+    // with a spare cell on either side. rows arrive in order from a single band
+    const size_t span = static_cast<size_t>(width) + 2;
+    if (y == 0) tone_error_.assign(span * 2, 0);
+    int* error = tone_error_.data() + (y & 1) * span + 1;
+    int* below = tone_error_.data() + ((y + 1) & 1) * span + 1;
+    std::fill(below - 1, below + width + 1, 0);
+    const int top = get_charset().size - 1;
+    for (int x = 0; x < width; ++x) {
+        const int value = tone_fine_[luma[x]] + error[x];
+        const int glyph = std::clamp((value + 32) >> 6, 0, top);
+        const int rest = value - (glyph << 6);
+        error[x + 1] += rest * 7 / 16;
+        below[x - 1] += rest * 3 / 16;
+        below[x] += rest * 5 / 16;
+        below[x + 1] += rest / 16;
+        glyphs[x] = static_cast<uint8_t>(glyph);
+    }
+}
+
+void Interpreter::hold_tone_row(int y, int width, const uint8_t* rgb, uint8_t* tone) {
+    const size_t row = static_cast<size_t>(y) * width;
+    uint8_t* glyphs = glyphs_.data() + row;
+    const uint8_t* held = held_glyphs_.data() + row;
+    // last frame's glyph stays while the tone is inside that glyph's range widened
+    // by the band on both sides (in the 1/64 glyph steps of tone_fine_)
+    const int band = static_cast<int>(config_.tone_hysteresis * 64.0f);
+    glyph_row_kernel()(rgb, width, kIdentityLut.data(), tone);
+    for (int x = 0; x < width; ++x) {
+        const int fine = tone_fine_[tone[x]];
+        if (fine >= held[x] * 64 - band && fine < (held[x] + 1) * 64 + band) glyphs[x] = held[x];
+    }
+}
+
+template <ColorDepth Depth>
+void Interpreter::merge_row_colors(int y, int width, int max_distance2) {
+    const size_t row = static_cast<size_t>(y) * width;
+    const uint8_t* glyphs = glyphs_.data() + row;
+    // Cells whose colour is within the tolerance of the current run's colour take
+    // it over, so the stateful encoder sees no change. Always compared against the
+    // run's anchor colour (not the previous cell), so merging can't drift.
+    auto merge = [&](uint32_t* colors, bool skip_blanks) {
+        uint32_t run = kNoColor;
+        const int16_t* run_lab = nullptr;
+        for (int x = 0; x < width; ++x) {
+            if (skip_blanks && glyphs[x] == 0) continue;  // blanks carry no visible foreground
+            const uint32_t color = colors[x];
+            if (color == run) continue;
+            const int16_t* lab = lab_of(Depth == ColorDepth::TRUECOLOR ? color : palette_rgb(Depth, color));
+            if (run_lab && lab_distance2(lab, run_lab) <= max_distance2) {
+                colors[x] = run;
+            } else {
+                run = color;
+                run_lab = lab;
+            }
+        }
+    };
+    merge(colors_.data() + row, true);
+    // every cell of a two-colour mode shows its background
+    if (!backgrounds_.empty()) merge(backgrounds_.data() + row, false);
+}
+
+template <bool Color, ColorDepth Depth, typename Writer>
+void Interpreter::encode_row(Writer& out, const Charset& charset, int y, int width) const {
+    const uint8_t* glyphs = glyphs_.data() + static_cast<size_t>(y) * width;
+    const uint32_t* colors = Color ? colors_.data() + static_cast<size_t>(y) * width : nullptr;
+    const uint32_t* backgrounds = Color && !backgrounds_.empty() ? backgrounds_.data() + static_cast<size_t>(y) * width : nullptr;
+
+    SgrState sgr;  // colours currently set on the terminal
+    encode_cells<Color, Depth>(out, charset.glyphs, glyphs, colors, backgrounds, width, true, sgr, config_.compress_runs);
+    // one reset per line keeps every row self-contained (rows are encoded in parallel)
+    if (Color && sgr.set()) out.put("\x1b[0m", 4);
+    out.put("\n", 1);
+}
+
+template <bool Color, ColorDepth Depth, typename Writer>
+void Interpreter::encode_row_delta(Writer& out, const Charset& charset, int y, int width) const {
+    const size_t row = static_cast<size_t>(y) * width;
+    const uint8_t* glyphs = glyphs_.data() + row;
+    const uint8_t* shown = shown_glyphs_.data() + row;
+    const uint32_t* colors = Color ? colors_.data() + row : nullptr;
+    const uint32_t* shown_colors = Color ? shown_colors_.data() + row : nullptr;
+    const bool two_color = Color && !backgrounds_.empty();
+    const uint32_t* backgrounds = two_color ? backgrounds_.data() + row : nullptr;
+    const uint32_t* shown_backgrounds = two_color ? shown_backgrounds_.data() + row : nullptr;
+    // blanks show no foreground, so only their glyph (and background) counts as a change
+    auto changed = [&](int x) {
+        if (glyphs[x] != shown[x]) return true;
+        if (two_color && backgrounds[x] != shown_backgrounds[x]) return true;
+        if constexpr (Color) return glyphs[x] != 0 && colors[x] != shown_colors[x];
+        return false;
+    };
+
+    SgrState sgr;
+    int x = 0;
+    while (x < width) {
+        if (!changed(x)) {
+            ++x;
+            continue;
+        }
+        // a span swallows short unchanged gaps: rewriting a few cells is cheaper than
+        // another cursor move
+        int end = x + 1;
+        for (int i = end, gap = 0; i < width && gap <= kDeltaGap; ++i) {
+            if (changed(i)) {
+                end = i + 1;
+                gap = 0;
+            } else {
+                ++gap;
+            }
+        }
+        out.cursor_to(y, x);
+        encode_cells<Color, Depth>(out, charset.glyphs, glyphs + x, Color ? colors + x : nullptr,
+                                   two_color ? backgrounds + x : nullptr, end - x, end == width, sgr,
+                                   config_.compress_runs);
+        x = end;
+    }
+    if (Color && sgr.set()) out.put("\x1b[0m", 4);
 }
 
 
@@ -122,24 +1958,140 @@ std::string Interpreter::convert_from_file(const std::string& filename) {
         if (magic != "P6") {
             throw std::runtime_error("Unsupported PPM format");
         }
-        Image image(width, height, 3);
-        file.read(reinterpret_cast<char*>(image.data.data()), image.data.size());
-        return convert(image);
+        // read straight into an uninitialized buffer the Image adopts; only a short file
+        // gets its missing tail zeroed
+        const size_t size = static_cast<size_t>(width) * height * 3;
+        std::unique_ptr<uint8_t[]> pixels(new uint8_t[size]);
+        file.read(reinterpret_cast<char*>(pixels.get()), size);
+        std::fill(pixels.get() + file.gcount(), pixels.get() + size, uint8_t(0));
+        return convert(Image(pixels.release(), width, height, 3, [](uint8_t* p) { delete[] p; }));
     } else {
+        // decode straight from the mapped file, and keep stb's buffer as the image
+        const MappedFile file(filename);
+        if (file.size() > static_cast<size_t>(INT32_MAX)) {
+            throw std::runtime_error("Image file too large: " + filename);
+        }
         int width, height, channels;
-        unsigned char* data = stbi_load(filename.c_str(), &width, &height, &channels, 3);
+        unsigned char* data = stbi_load_from_memory(file.data(), static_cast<int>(file.size()), &width, &height, &channels, 3);
         if (!data) {
             throw std::runtime_error("Failed to load image: " + filename);
         }
-        Image image(width, height, 3);
-        std::memcpy(image.data.data(), data, width * height * 3);
-        stbi_image_free(data);
-        return convert(image);
+        return convert(Image(data, width, height, 3, [](uint8_t* pixels) { stbi_image_free(pixels); }));
+    }
+}
+
+PixelBuffer::PixelBuffer(size_t size)
+    : data_(new uint8_t[size]()), size_(size), deleter_([](uint8_t* pixels) { delete[] pixels; }) {}
+
+PixelBuffer::PixelBuffer(uint8_t* pixels, size_t size, Deleter deleter)
+    : data_(pixels), size_(size), deleter_(std::move(deleter)) {}
+
+PixelBuffer::PixelBuffer(const PixelBuffer& other) : size_(other.size_) {
+    if (size_ == 0) return;
+    data_ = new uint8_t[size_];  // overwritten right away, no zero-fill
+    std::memcpy(data_, other.data_, size_);
+    deleter_ = [](uint8_t* pixels) { delete[] pixels; };
+}
+
+PixelBuffer::PixelBuffer(PixelBuffer&& other) noexcept
+    : data_(other.data_), size_(other.size_), deleter_(std::move(other.deleter_)) {
+    other.data_ = nullptr;
+    other.size_ = 0;
+    other.deleter_ = nullptr;
+}
+
+PixelBuffer& PixelBuffer::operator=(PixelBuffer other) noexcept {
+    std::swap(data_, other.data_);
+    std::swap(size_, other.size_);
+    std::swap(deleter_, other.deleter_);
+    return *this;
+}
+
+PixelBuffer::~PixelBuffer() {
+    if (data_ && deleter_) deleter_(data_);
+}
+
+MappedFile::MappedFile(const std::string& path) {
+#if !defined(_WIN32) && !defined(_WIN64)
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    struct stat info;
+    if (::fstat(fd, &info) == 0 && S_ISREG(info.st_mode) && info.st_size > 0) {
+        void* view = ::mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (view != MAP_FAILED) {
+            ::madvise(view, static_cast<size_t>(info.st_size), MADV_SEQUENTIAL);  // decoders read front to back
+            data_ = static_cast<const uint8_t*>(view);
+            size_ = static_cast<size_t>(info.st_size);
+            mapped_ = true;
+            ::close(fd);
+            return;
+        }
+    }
+    // pipes, /dev/stdin, process substitution (no size, can't seek) or mmap failed: read to EOF
+    uint8_t chunk[65536];
+    for (;;) {
+        const ssize_t n = ::read(fd, chunk, sizeof(chunk));
+        if (n > 0) {
+            contents_.insert(contents_.end(), chunk, chunk + n);
+        } else if (n == 0) {
+            break;
+        } else if (errno != EINTR) {
+            ::close(fd);
+            throw std::runtime_error("Failed to read file: " + path);
+        }
+    }
+    ::close(fd);
+#else
+    // no mmap here: read the file instead (streamed, so non-seekable inputs work too)
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        throw std::runtime_error("Cannot open file: " + path);
+    }
+    contents_.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+    if (file.bad()) {
+        throw std::runtime_error("Failed to read file: " + path);
+    }
+#endif
+    data_ = contents_.data();
+    size_ = contents_.size();
+}
+
+MappedFile::~MappedFile() {
+#if !defined(_WIN32) && !defined(_WIN64)
+    if (mapped_) ::munmap(const_cast<uint8_t*>(data_), size_);
+#endif
+}
+
+void StringSink::write(std::string_view frame) {
+    buffer_.assign(frame.data(), frame.size());
+}
+
+void FdSink::write(std::string_view frame) {
+    const char* p = frame.data();
+    size_t left = frame.size();
+    while (left > 0) {
+#if defined(_WIN32) || defined(_WIN64)
+        int n = ::_write(fd_, p, static_cast<unsigned int>(std::min<size_t>(left, 1u << 30)));
+#else
+        ssize_t n = ::write(fd_, p, left);
+        if (n < 0 && errno == EINTR) continue;
+#endif
+        if (n <= 0) throw std::runtime_error("Failed to write frame to fd " + std::to_string(fd_));
+        p += n;
+        left -= static_cast<size_t>(n);
     }
 }
 
+void CallbackSink::write(std::string_view frame) {
+    callback_(frame);
+}
+
 void Interpreter::set_mode(Mode mode) {
     config_.mode = mode;
+    rebuild_tone_lut();
+    reset_delta();
 }
 
 void Interpreter::set_target_size(int width, int height) {
@@ -149,14 +2101,88 @@ void Interpreter::set_target_size(int width, int height) {
 
 void Interpreter::set_contrast(float contrast) {
     config_.contrast = contrast;
+    rebuild_tone_lut();
 }
 
 void Interpreter::set_brightness(float brightness) {
     config_.brightness = brightness;
+    rebuild_tone_lut();
 }
 
 void Interpreter::set_color(bool use_color) {
     config_.use_color = use_color;
+    reset_delta();
+}
+
+void Interpreter::set_hysteresis(float tone_steps, float delta_e) {
+    config_.tone_hysteresis = tone_steps;
+    config_.color_hysteresis = delta_e;
+}
+
+void Interpreter::set_tone_dither(ToneDither dither) {
+    config_.tone_dither = dither;
+}
+
+void Interpreter::set_color_tolerance(float delta_e) {
+    config_.color_tolerance = delta_e;
+}
+
+void Interpreter::set_compress_runs(bool compress) {
+    config_.compress_runs = compress;
+}
+
+void Interpreter::set_frame_byte_budget(size_t bytes) {
+    config_.frame_byte_budget = bytes;
+    quality_level_ = 0;
+    headroom_frames_ = 0;
+}
+
+void Interpreter::set_color_depth(ColorDepth depth) {
+    config_.color_depth = depth;
+    reset_delta();
+}
+
+void Interpreter::set_filter(Filter filter) {
+    config_.filter = filter;
+}
+
+void Interpreter::set_threads(int threads) {
+    config_.threads = threads;
+    int count = threads > 0 ? threads : static_cast<int>(std::thread::hardware_concurrency());
+    if (count <= 1) {
+        pool_.reset();
+    } else if (!pool_ || pool_->size() != count) {
+        pool_ = std::make_unique<ThreadPool>(count);
+    }
+}
+
+void Interpreter::rebuild_tone_lut() {
+    // same float pipeline convert() used to run per pixel, evaluated once per luminance level
+    // (keyed on rounded 8-bit luma, so a pixel right at a glyph boundary can land one glyph
+    // over compared to feeding the unrounded float luminance through it)
+    const Charset charset = get_charset();
+    for (int v = 0; v < 256; ++v) {
+        float luminance = v / 255.0f;
+        if (config_.use_gamma_correction) luminance = apply_gamma_correction(luminance);
+        luminance = std::clamp(luminance * config_.contrast + config_.brightness, 0.0f, 1.0f);
+        luminance = apply_perceptual_mapping(luminance);
+        if (config_.mode == Mode::HALF_BLOCK || config_.mode == Mode::QUADRANT || config_.mode == Mode::SEXTANT) {
+            // monochrome block shapes: each pixel is simply on or off
+            tone_lut_[v] = luminance >= 0.5f;
+            continue;
+        }
+        if (config_.mode == Mode::BRAILLE || config_.mode == Mode::SHAPE) {
+            // full tone range per sample: braille thresholds it into dots, SHAPE matches it as coverage
+            tone_lut_[v] = static_cast<uint8_t>(std::lround(luminance * 255.0f));
+            continue;
+        }
+        // EDGE tones use only the ramp in front of its direction glyphs
+        const int levels = config_.mode == Mode::EDGE ? kEdgeRamp : charset.size;
+        int index = static_cast<int>(luminance * (levels - 1));
+        tone_lut_[v] = static_cast<uint8_t>(std::clamp(index, 0, levels - 1));
+        // same position on the ramp with 6 fractional bits, for tone_dither
+        tone_fine_[v] = static_cast<uint16_t>(std::clamp(static_cast<int>(luminance * (levels - 1) * 64.0f), 0, (levels - 1) * 64));
+    }
 }
 
 float Interpreter::apply_gamma_correction(float value) const {
@@ -170,74 +2196,223 @@ float Interpreter::apply_perceptual_mapping(float intensity) const {
     return std::clamp(3.0f * x * x - 2.0f * x * x * x, 0.0f, 1.0f);
 }
 
-std::string Interpreter::get_color_escape_code(uint8_t r, uint8_t g, uint8_t b) const {
-    uint32_t key = (uint32_t(r) << 16) | (uint32_t(g) << 8) | uint32_t(b);
-    auto it = color_escape_cache_.find(key);
-    if (it != color_escape_cache_.end()) return it->second;
-    char buf[32];
-    std::snprintf(buf, sizeof(buf), "\x1b[38;2;%u;%u;%um", r, g, b);
-    auto em = color_escape_cache_.emplace(key, std::string(buf));
-    return em.first->second;
+namespace {
+
+constexpr std::string_view kCleanGlyphs[] = {" ", ".", ":", "-", "=", "+", "*", "#", "%", "@"};
+constexpr std::string_view kHighGlyphs[] = {" ", "'", "`", "^", "\"", ",", ":", ";", "I", "l", "!", "i",
+                ">", "<", "~", "+", "_", "-", "?", "]", "[", "}", "{", "1",
+                ")", "(", "|", "\\", "t", "f", "j", "r", "x", "n", "u",
+                "v", "c", "z", "X", "Y", "U", "J", "C", "L", "Q", "0",
+                "O", "Z", "m", "w", "q", "p", "d", "b", "k", "h", "a",
+                "o", "*", "#", "M", "W", "&", "8", "%", "B", "@", "$"};
+constexpr std::string_view kBlockGlyphs[] = {" ", "░", "▒", "▓", "█"};
+// the CLEAN ramp, then the edge directions
+constexpr std::string_view kEdgeGlyphs[] = {" ", ".", ":", "-", "=", "+", "*", "#", "%", "@",
+                                            "|", "/", "-", "\\", "_"};
+static_assert(std::size(kEdgeGlyphs) == kEdgeRamp + 5, "EDGE ramp length out of sync");
+// indexed by upper | lower << 1
+constexpr std::string_view kHalfBlockGlyphs[] = {" ", "▀", "▄", "█"};
+
+// U+2800 + dot bits as UTF-8; no dots is a plain space (1 byte instead of 3)
+constexpr std::array<char, 256 * 3> make_braille_text() {
+    std::array<char, 256 * 3> text{};
+    for (int i = 0; i < 256; ++i) {
+        text[i * 3] = static_cast<char>(0xe2);
+        text[i * 3 + 1] = static_cast<char>(0xa0 + (i >> 6));
+        text[i * 3 + 2] = static_cast<char>(0x80 + (i & 0x3f));
+    }
+    return text;
 }
+constexpr std::array<char, 256 * 3> kBrailleText = make_braille_text();
 
-const std::vector<std::string>& Interpreter::get_charset() const {
-    static const std::vector<std::string> clean = {" ", ".", ":", "-", "=", "+", "*", "#", "%", "@"};
-    static const std::vector<std::string> high = {" ", "'", "`", "^", "\"", ",", ":", ";", "I", "l", "!", "i",
-                    ">", "<", "~", "+", "_", "-", "?", "]", "[", "}", "{", "1",
-                    ")", "(", "|", "\\", "t", "f", "j", "r", "x", "n", "u",
-                    "v", "c", "z", "X", "Y", "U", "J", "C", "L", "Q", "0",
-                    "O", "Z", "m", "w", "q", "p", "d", "b", "k", "h", "a",
-                    "o", "*", "#", "M", "W", "&", "8", "%", "B", "@", "$"};
-    static const std::vector<std::string> block = {" ", "░", "▒", "▓", "█"};
-    switch (config_.mode) {
-        case Mode::CLEAN: return clean;
-        case Mode::HIGH_FIDELITY: return high;
-        case Mode::BLOCK: return block;
+constexpr std::array<std::string_view, 256> make_braille_glyphs() {
+    std::array<std::string_view, 256> glyphs{};
+    glyphs[0] = " ";
+    for (int i = 1; i < 256; ++i) glyphs[i] = std::string_view(kBrailleText.data() + i * 3, 3);
+    return glyphs;
+}
+constexpr std::array<std::string_view, 256> kBrailleGlyphs = make_braille_glyphs();
+
+// indexed by the set samples, bit 0 upper left, 1 upper right, 2 lower left, 3 lower right
+constexpr std::string_view kQuadrantGlyphs[] = {" ", "▘", "▝", "▀", "▖", "▌", "▞", "▛",
+                                                "▗", "▚", "▐", "▜", "▄", "▙", "▟", "█"};
+
+// same bit order over 2x3 samples. U+1FB00.. (Symbols for Legacy Computing) holds
+// every pattern except the four that already exist as blank, ▌, ▐ and █
+constexpr std::array<char, 64 * 4> make_sextant_text() {
+    std::array<char, 64 * 4> text{};
+    for (int i = 1; i < 63; ++i) {
+        const int code = 0x1fb00 + i - 1 - (i > 21) - (i > 42);
+        text[i * 4] = static_cast<char>(0xf0);
+        text[i * 4 + 1] = static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+        text[i * 4 + 2] = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+        text[i * 4 + 3] = static_cast<char>(0x80 | (code & 0x3f));
     }
-    return clean;
+    return text;
 }
+constexpr std::array<char, 64 * 4> kSextantText = make_sextant_text();
 
-float Interpreter::get_luminance(uint8_t r, uint8_t g, uint8_t b) const {
-    return 0.299f * r / 255.0f + 0.587f * g / 255.0f + 0.114f * b / 255.0f;
+constexpr std::array<std::string_view, 64> make_sextant_glyphs() {
+    std::array<std::string_view, 64> glyphs{};
+    for (int i = 1; i < 63; ++i) glyphs[i] = std::string_view(kSextantText.data() + i * 4, 4);
+    glyphs[0] = " ";
+    glyphs[21] = "▌";
+    glyphs[42] = "▐";
+    glyphs[63] = "█";
+    return glyphs;
 }
+constexpr std::array<std::string_view, 64> kSextantGlyphs = make_sextant_glyphs();
+
+struct GlyphTable {
+    const std::string_view* glyphs;
+    int size;
+};
 
-const std::string& Interpreter::map_intensity_to_char(float intensity) const {
-    const auto& charset = get_charset();
-    int index = static_cast<int>(intensity * (charset.size() - 1));
-    index = std::clamp(index, 0, static_cast<int>(charset.size() - 1));
-    return charset[index];
+GlyphTable glyph_table(Mode mode) {
+    switch (mode) {
+        case Mode::CLEAN: return {kCleanGlyphs, static_cast<int>(std::size(kCleanGlyphs))};
+        case Mode::HIGH_FIDELITY: return {kHighGlyphs, static_cast<int>(std::size(kHighGlyphs))};
+        case Mode::BLOCK: return {kBlockGlyphs, static_cast<int>(std::size(kBlockGlyphs))};
+        case Mode::HALF_BLOCK: return {kHalfBlockGlyphs, static_cast<int>(std::size(kHalfBlockGlyphs))};
+        case Mode::BRAILLE: return {kBrailleGlyphs.data(), static_cast<int>(kBrailleGlyphs.size())};
+        case Mode::QUADRANT: return {kQuadrantGlyphs, static_cast<int>(std::size(kQuadrantGlyphs))};
+        case Mode::SEXTANT: return {kSextantGlyphs.data(), static_cast<int>(kSextantGlyphs.size())};
+        case Mode::EDGE: return {kEdgeGlyphs, static_cast<int>(std::size(kEdgeGlyphs))};
+        case Mode::SHAPE: return {kShapeGlyphs.data(), kShapeCount};
+    }
+    return {kCleanGlyphs, static_cast<int>(std::size(kCleanGlyphs))};
 }
 
-Image Interpreter::resize_image(const Image& image, int new_width, int new_height) const {
-    Image resized(new_width, new_height, image.channels);
-    
-    float x_ratio = static_cast<float>(image.width) / new_width;
-    float y_ratio = static_cast<float>(image.height) / new_height;
-    
-    for (int y = 0; y < new_height; ++y) {
-        for (int x = 0; x < new_width; ++x) {
-            int src_x = static_cast<int>(x * x_ratio);
-            int src_y = static_cast<int>(y * y_ratio);
-            
-            src_x = std::clamp(src_x, 0, image.width - 1);
-            src_y = std::clamp(src_y, 0, image.height - 1);
-            
-            for (int c = 0; c < image.channels; ++c) {
-                int src_index = (src_y * image.width + src_x) * image.channels + c;
-                int dst_index = (y * new_width + x) * image.channels + c;
-                resized.data[dst_index] = image.data[src_index];
+template <ColorDepth Depth>
+void encode_grid_ansi(const CellGrid& grid, std::string& out, bool compress_runs) {
+    const std::string_view* glyph_text = glyph_table(grid.mode).glyphs;
+    const int width = grid.width;
+    const bool color = !grid.colors.empty();
+    const bool two_color = color && !grid.backgrounds.empty();
+    // palette depths quantize one row at a time (no dithering: that needs the tone stage's samples)
+    const bool quantize = Depth != ColorDepth::TRUECOLOR && color;
+    std::vector<uint32_t> row(quantize ? width * (two_color ? 2 : 1) : 0);
+    std::vector<uint8_t> collapsed(quantize && two_color ? width : 0);
+    auto palette_row = [&](const uint32_t* rgb, uint32_t* index) {
+        const uint8_t* lut = palette_lut(Depth);
+        for (int x = 0; x < width; ++x) {
+            index[x] = lut[((rgb[x] >> 9) & 0x7c00) | ((rgb[x] >> 6) & 0x3e0) | ((rgb[x] >> 3) & 0x1f)];
+        }
+        return index;
+    };
+    auto encode = [&](auto& writer) {
+        for (int y = 0; y < grid.height; ++y) {
+            const size_t offset = static_cast<size_t>(y) * width;
+            const uint8_t* glyphs = grid.glyphs.data() + offset;
+            SgrState sgr;
+            if (!color) {
+                encode_cells<false, Depth>(writer, glyph_text, glyphs, nullptr, nullptr, width, true, sgr, compress_runs);
+                writer.put("\n", 1);
+                continue;
+            }
+            const uint32_t* colors = grid.colors.data() + offset;
+            const uint32_t* backgrounds = two_color ? grid.backgrounds.data() + offset : nullptr;
+            if (quantize) {
+                colors = palette_row(colors, row.data());
+                if (two_color) {
+                    // same as map_row: both colours on one palette entry is a plain background cell
+                    backgrounds = palette_row(backgrounds, row.data() + width);
+                    for (int x = 0; x < width; ++x) collapsed[x] = colors[x] == backgrounds[x] ? 0 : glyphs[x];
+                    glyphs = collapsed.data();
+                }
             }
+            encode_cells<true, Depth>(writer, glyph_text, glyphs, colors, backgrounds, width, true, sgr, compress_runs);
+            if (sgr.set()) writer.put("\x1b[0m", 4);
+            writer.put("\n", 1);
         }
-    }
-    
-    return resized;
+    };
+    // same measure-then-write scheme as convert()
+    ByteCounter counter;
+    encode(counter);
+    out.resize(counter.size);
+    ByteWriter writer{&out[0]};
+    encode(writer);
+}
+
+} // namespace
+
+Interpreter::Charset Interpreter::get_charset() const {
+    const GlyphTable table = glyph_table(config_.mode);
+    return {table.glyphs, table.size};
 }
 
+std::string_view CellGrid::glyph_text(uint8_t glyph) const {
+    const GlyphTable table = glyph_table(mode);
+    return glyph < table.size ? table.glyphs[glyph] : table.glyphs[0];
+}
 
+void encode_ansi(const CellGrid& grid, std::string& out, ColorDepth depth, bool compress_runs) {
+    switch (depth) {
+        case ColorDepth::TRUECOLOR: encode_grid_ansi<ColorDepth::TRUECOLOR>(grid, out, compress_runs); break;
+        case ColorDepth::ANSI256: encode_grid_ansi<ColorDepth::ANSI256>(grid, out, compress_runs); break;
+        case ColorDepth::ANSI16: encode_grid_ansi<ColorDepth::ANSI16>(grid, out, compress_runs); break;
+    }
+}
 
-uint8_t Interpreter::get_pixel_value(const Image& image, int x, int y, int channel) const {
-    int index = (y * image.width + x) * image.channels + channel;
-    return image.data[index];
+void encode_text(const CellGrid& grid, std::string& out) {
+    out.clear();
+    const GlyphTable table = glyph_table(grid.mode);
+    for (int y = 0; y < grid.height; ++y) {
+        const uint8_t* glyphs = grid.glyphs.data() + static_cast<size_t>(y) * grid.width;
+        for (int x = 0; x < grid.width; ++x) out += table.glyphs[glyphs[x]];
+        out += '\n';
+    }
+}
+
+void encode_html(const CellGrid& grid, std::string& out) {
+    static const char kHex[] = "0123456789abcdef";
+    out.clear();
+    out += "<pre class=\"ascii-art\">\n";
+    const GlyphTable table = glyph_table(grid.mode);
+    const bool color = !grid.colors.empty();
+    const bool two_color = color && !grid.backgrounds.empty();
+    auto hex = [&](uint32_t rgb) {
+        out += '#';
+        for (int shift = 20; shift >= 0; shift -= 4) out += kHex[(rgb >> shift) & 0xf];
+    };
+    for (int y = 0; y < grid.height; ++y) {
+        const size_t offset = static_cast<size_t>(y) * grid.width;
+        const uint8_t* glyphs = grid.glyphs.data() + offset;
+        const uint32_t* colors = color ? grid.colors.data() + offset : nullptr;
+        const uint32_t* backgrounds = two_color ? grid.backgrounds.data() + offset : nullptr;
+        // one span per colour run; blanks show no foreground, so they never start one
+        uint32_t open_fg = kNoColor, open_bg = kNoColor;
+        for (int x = 0; x < grid.width; ++x) {
+            const uint8_t glyph = glyphs[x];
+            const uint32_t fg = color && glyph != 0 ? colors[x] : open_fg;
+            const uint32_t bg = two_color ? backgrounds[x] : kNoColor;
+            if (fg != open_fg || bg != open_bg) {
+                if (open_fg != kNoColor || open_bg != kNoColor) out += "</span>";
+                open_fg = fg;
+                open_bg = bg;
+                out += "<span style=\"";
+                if (fg != kNoColor) {
+                    out += "color:";
+                    hex(fg);
+                    out += ';';
+                }
+                if (bg != kNoColor) {
+                    out += "background-color:";
+                    hex(bg);
+                    out += ';';
+                }
+                out += "\">";
+            }
+            const std::string_view text = table.glyphs[glyph];
+            if (text == "<") out += "&lt;";
+            else if (text == ">") out += "&gt;";
+            else if (text == "&") out += "&amp;";
+            else out += text;
+        }
+        if (open_fg != kNoColor || open_bg != kNoColor) out += "</span>";
+        out += '\n';
+    }
+    out += "</pre>\n";
 }
 
 }
@@ -1,8 +1,10 @@
 #pragma once
+#include <array>
+#include <functional>
+#include <memory>
 #include <string>
 #include <vector>
 #include <cstdint>
-#include <unordered_map>
 #include <string_view>
 
 extern "C" {
@@ -19,18 +21,165 @@ using ::stbi_image_free;
 enum class Mode {
     CLEAN,
     HIGH_FIDELITY,
-    BLOCK
+    BLOCK,
+    // two pixels per cell: ▀ with the upper pixel as foreground and the lower one as
+    // background colour (▀▄█ on/off shapes without colour)
+    HALF_BLOCK,
+    // 2x4 dots per cell (U+2800 braille patterns), thresholded from the tone curve
+    BRAILLE,
+    // 2x2 / 2x3 block shapes (▚ ▙ ..., sextants need a Unicode 13 font). With colour
+    // each cell's samples are split into a foreground and a background colour
+    QUADRANT,
+    SEXTANT,
+    // CLEAN's tone ramp, with | / - \ _ where a Sobel pass over 3x3 samples per
+    // cell finds a strong edge
+    EDGE,
+    // 4x8 samples per cell matched against coverage bitmaps of ~55 ASCII glyphs; the
+    // slowest mode, meant for stills and batch jobs
+    SHAPE
+};
+
+// how source pixels are reduced to one sample per cell
+enum class Filter {
+    NEAREST,   // one source pixel per cell (fastest)
+    BOX,       // area average over everything the cell covers
+    BILINEAR
+};
+
+// escape flavour used when Config::use_color is set
+enum class ColorDepth {
+    TRUECOLOR,  // \x1b[38;2;r;g;bm
+    ANSI256,    // xterm 256-colour palette, \x1b[38;5;nm
+    ANSI16      // basic 16 colours, \x1b[3Xm / \x1b[9Xm
+};
+
+// dithering of the tone ramp (CLEAN, HIGH_FIDELITY, BLOCK)
+enum class ToneDither {
+    NONE,
+    BAYER,           // ordered 8x8 Bayer offsets: position-only, so rows stay parallel
+    FLOYD_STEINBERG  // error diffusion: smoother, but serial (converts on one thread)
+};
+
+// Pixel bytes of an Image: either allocated here (zero-filled) or a decoder's buffer
+// adopted as is and released through its deleter. Copies are deep and always owned;
+// moves transfer the adopted buffer and its deleter.
+class PixelBuffer {
+public:
+    using Deleter = std::function<void(uint8_t*)>;
+
+    PixelBuffer() = default;
+    explicit PixelBuffer(size_t size);
+    // adopts `pixels`; an empty deleter borrows memory that must outlive the buffer
+    PixelBuffer(uint8_t* pixels, size_t size, Deleter deleter);
+    PixelBuffer(const PixelBuffer& other);
+    PixelBuffer(PixelBuffer&& other) noexcept;
+    PixelBuffer& operator=(PixelBuffer other) noexcept;
+    ~PixelBuffer();
+
+    uint8_t* data() { return data_; }
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+    uint8_t& operator[](size_t i) { return data_[i]; }
+    const uint8_t& operator[](size_t i) const { return data_[i]; }
+    uint8_t* begin() { return data_; }
+    uint8_t* end() { return data_ + size_; }
+    const uint8_t* begin() const { return data_; }
+    const uint8_t* end() const { return data_ + size_; }
+
+private:
+    uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    Deleter deleter_;
 };
 
 struct Image {
-    std::vector<uint8_t> data;
+    PixelBuffer data;
     int width;
     int height;
     int channels;
     
-    Image(int w, int h, int c = 3) : width(w), height(h), channels(c) {
-        data.resize(w * h * c);
-    }
+    Image(int w, int h, int c = 3) : data(static_cast<size_t>(w) * h * c), width(w), height(h), channels(c) {}
+    // Wraps w * h * c decoded bytes without copying or zero-filling. The deleter frees
+    // them with the Image (e.g. stbi_image_free); an empty one borrows memory that
+    // outlives the Image, like one frame of a decoded GIF.
+    Image(uint8_t* pixels, int w, int h, int c, PixelBuffer::Deleter deleter)
+        : data(pixels, static_cast<size_t>(w) * h * c, std::move(deleter)), width(w), height(h), channels(c) {}
+};
+
+// Read-only view of a whole file for the in-memory decoders: mmap on POSIX, read into
+// memory elsewhere (or when mapping fails). Throws std::runtime_error if it can't be opened.
+class MappedFile {
+public:
+    explicit MappedFile(const std::string& path);
+    ~MappedFile();
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const uint8_t* data() const { return data_; }
+    size_t size() const { return size_; }
+
+private:
+    const uint8_t* data_ = nullptr;
+    size_t size_ = 0;
+    bool mapped_ = false;
+    std::vector<uint8_t> contents_;  // fallback copy when not mapped
+};
+
+// Converted cells as plain planes, for output formats other than one ANSI string,
+// custom renderers or diffing. Row-major, width * height entries per plane.
+struct CellGrid {
+    int width = 0;
+    int height = 0;
+    Mode mode = Mode::CLEAN;        // charset the glyph indices refer to
+    std::vector<uint8_t> glyphs;    // glyph index per cell, 0 = blank
+    std::vector<uint32_t> colors;   // 0xRRGGBB of each cell (empty = monochrome)
+    // background 0xRRGGBB for two-colour modes (HALF_BLOCK, QUADRANT, SEXTANT), empty otherwise.
+    // glyph 0 then shows only the background
+    std::vector<uint32_t> backgrounds;
+    // UTF-8 text of a glyph index in this grid's mode
+    std::string_view glyph_text(uint8_t glyph) const;
+};
+
+// CellGrid encoders. Each replaces the contents of `out`, reusing its capacity
+// (encode_ansi gives convert()'s bytes unless color_dither, color_tolerance or a byte budget is set)
+void encode_ansi(const CellGrid& grid, std::string& out, ColorDepth depth = ColorDepth::TRUECOLOR,
+                 bool compress_runs = false);
+void encode_text(const CellGrid& grid, std::string& out);
+void encode_html(const CellGrid& grid, std::string& out);
+
+// Destination for convert_to(). The frame view is only valid during write().
+class Sink {
+public:
+    virtual ~Sink() = default;
+    virtual void write(std::string_view frame) = 0;
+};
+
+// copies each frame into a caller-owned string (its capacity is reused across frames)
+class StringSink : public Sink {
+public:
+    explicit StringSink(std::string& buffer) : buffer_(buffer) {}
+    void write(std::string_view frame) override;
+private:
+    std::string& buffer_;
+};
+
+// writes each frame to a file descriptor (e.g. 1 for stdout), retrying short writes
+class FdSink : public Sink {
+public:
+    explicit FdSink(int fd) : fd_(fd) {}
+    void write(std::string_view frame) override;
+private:
+    int fd_;
+};
+
+// hands each frame to a user callback
+class CallbackSink : public Sink {
+public:
+    explicit CallbackSink(std::function<void(std::string_view)> callback) : callback_(std::move(callback)) {}
+    void write(std::string_view frame) override;
+private:
+    std::function<void(std::string_view)> callback_;
 };
 
 struct Config {
@@ -44,38 +193,194 @@ struct Config {
     float char_aspect_ratio = 0.43f;
     bool use_gamma_correction = true;
     bool use_color = false;
+    ColorDepth color_depth = ColorDepth::TRUECOLOR;
+    // ordered (Bayer) dithering before palette quantization, ANSI256/ANSI16 only
+    bool color_dither = false;
+    // spreads flat gradients over neighbouring ramp glyphs instead of banding
+    ToneDither tone_dither = ToneDither::NONE;
+    // Animation flicker control, 0 = off. A cell keeps the previous frame's glyph until
+    // its tone leaves that glyph's range by more than tone_hysteresis glyph steps (ramp
+    // modes), and each colour until it moves more than color_hysteresis CIELAB Delta E
+    float tone_hysteresis = 0.0f;
+    float color_hysteresis = 0.0f;
+    // Neighbouring cells within this CIELAB Delta E of the current colour run
+    // reuse its colour, which saves escapes on photographic input. 0 = exact match
+    float color_tolerance = 0.0f;
+    // Per-frame output cap in bytes for colour output, 0 = unlimited. Frames over it
+    // get coarser colours and a looser run tolerance, one quality step at a time
+    size_t frame_byte_budget = 0;
+    // Encode long glyph runs as CSI n b (REP) and blank spans as erase + cursor
+    // forward / erase-to-end-of-line. Needs a terminal that implements REP (xterm,
+    // VTE, Windows Terminal, ...)
+    bool compress_runs = false;
+    // BRAILLE: threshold dots against a 4x4 Bayer matrix instead of the midpoint
+    bool braille_dither = false;
+    // EDGE: gradient strength that turns a cell into an edge glyph, as a fraction of
+    // a full black-to-white step across the cell
+    float edge_threshold = 0.25f;
     // If true, prefer Unicode even on Windows consoles
     bool force_unicode = false;
+    Filter filter = Filter::NEAREST;
+    // worker threads used by convert(), 0 = one per hardware thread
+    int threads = 1;
+};
+
+// byte accounting for the most recent conversion
+struct FrameStats {
+    size_t bytes = 0;           // size of the frame that was produced
+    size_t bytes_unmerged = 0;  // what it would have been without color_tolerance merging
+    int quality_level = 0;      // frame_byte_budget step used, 0 = full colour precision
+    bool delta = false;         // convert_delta() sent only the changed cells
 };
 
+class ThreadPool;
+
 class Interpreter {
 public:
     Interpreter(const Config& config = Config{});
+    ~Interpreter();
+    // copies take the Config only: they get their own thread pool and start without a
+    // previous frame (no delta or hysteresis state)
+    Interpreter(const Interpreter& other);
+    Interpreter& operator=(const Interpreter& other);
+    Interpreter(Interpreter&&) noexcept;
+    Interpreter& operator=(Interpreter&&) noexcept;
     
     std::string convert(const Image& image);
+    // Same output as convert() but written into `out`, reusing its capacity.
+    // Converting same-sized frames into the same string does no heap allocation.
+    void convert_into(const Image& image, std::string& out);
+    // converts into an internal reusable buffer and passes the frame to `sink`
+    void convert_to(const Image& image, Sink& sink);
+    // For playback: writes only what changed since the previous convert_delta() frame,
+    // as cursor moves plus the changed cells, assuming the terminal still shows that
+    // frame at the cursor home position. Falls back to "\x1b[H" + full frame whenever
+    // that is smaller, the mode/colour changed, or after reset_delta(); a size change
+    // also clears the screen first.
+    void convert_delta(const Image& image, std::string& out);
+    // forget the displayed frame (e.g. after clearing or resizing the terminal), which
+    // also restarts Config::tone_hysteresis / color_hysteresis
+    void reset_delta();
     std::string convert_from_file(const std::string& filename);
+    // Runs the conversion up to the cells and stores them in `grid` (colour planes are
+    // filled when Config::use_color is set). Encode with encode_ansi/encode_text/encode_html,
+    // as often as needed.
+    void convert_cells(const Image& image, CellGrid& grid);
     
     void set_mode(Mode mode);
     void set_target_size(int width, int height = 0);
     void set_contrast(float contrast);
     void set_brightness(float brightness);
     void set_color(bool use_color);
+    void set_color_depth(ColorDepth depth);
+    void set_tone_dither(ToneDither dither);
+    void set_hysteresis(float tone_steps, float delta_e = 0.0f);
+    void set_color_tolerance(float delta_e);
+    void set_frame_byte_budget(size_t bytes);
+    void set_compress_runs(bool compress);
+
+    const FrameStats& last_frame_stats() const { return stats_; }
+    void set_filter(Filter filter);
+    void set_threads(int threads);
     
 private:
     Config config_;
     
-    const std::vector<std::string>& get_charset() const;
-    float get_luminance(uint8_t r, uint8_t g, uint8_t b) const;
-    const std::string& map_intensity_to_char(float intensity) const;
-    Image resize_image(const Image& image, int new_width, int new_height) const;
+    // constexpr glyph table of the current mode (UTF-8 strings indexed by glyph index)
+    struct Charset {
+        const std::string_view* glyphs;
+        int size;
+    };
+    Charset get_charset() const;
     float apply_gamma_correction(float value) const;
     float apply_perceptual_mapping(float intensity) const;
-    std::string get_color_escape_code(uint8_t r, uint8_t g, uint8_t b) const;
 
-    // cache for color escape sequences (key = 0xRRGGBB)
-    mutable std::unordered_map<uint32_t, std::string> color_escape_cache_;
+    // compiled tone table: 8-bit luminance -> glyph index. Folds gamma, contrast,
+    // brightness and the perceptual curve so convert() never touches floats per pixel.
+    // Rebuilt by the constructor and any setter that changes those inputs.
+    std::array<uint8_t, 256> tone_lut_{};
+    // same ramp position in 1/64 glyph steps, for Config::tone_dither
+    std::array<uint16_t, 256> tone_fine_{};
+    std::vector<int> tone_error_;  // Floyd-Steinberg error of the current and next row
+    void rebuild_tone_lut();
+    void diffuse_tone_row(int y, int width, const uint8_t* luma, uint8_t* glyphs);
+    static uint8_t luma8(uint8_t r, uint8_t g, uint8_t b) {
+        // BT.601 weights in 8.8 fixed point (77 + 150 + 29 = 256)
+        return static_cast<uint8_t>((77u * r + 150u * g + 29u * b + 128u) >> 8);
+    }
+
+    // convert() runs in two passes over row bands: map_row samples the source
+    // straight into the cell planes and each row is measured, then rows are
+    // encoded into the frame at their prefix-summed offsets
+    std::unique_ptr<ThreadPool> pool_;
+    std::vector<uint8_t> glyphs_;      // glyph index per cell
+    std::vector<uint32_t> colors_;     // 0xRRGGBB (or palette index) per cell
+    std::vector<uint32_t> backgrounds_; // same, background plane of two-colour modes
+    std::vector<size_t> row_offsets_;  // byte offset of each row in the frame (+ total)
+    std::vector<uint8_t> row_rgb_;     // sampled RGB of one cell row per band (every row under a byte budget)
+    std::vector<uint8_t> row_tone_;    // per-band scratch: sample tones + two cell-resolution RGB rows
+    std::vector<uint32_t> row_acc_;    // per-band box filter row sums
+    std::vector<uint16_t> row_lerp_;   // per-band bilinear rows (two filtered + the blend)
+    std::vector<size_t> row_unmerged_; // row sizes before colour merging (only when enabled)
+    FrameStats stats_;
+    int quality_level_ = 0;            // rate control step carried to the next frame
+    int headroom_frames_ = 0;          // consecutive frames well under budget
+    std::vector<uint8_t> shown_glyphs_;  // cells on screen after the last convert_delta()
+    std::vector<uint32_t> shown_colors_;
+    std::vector<uint32_t> shown_backgrounds_;
+    std::vector<size_t> delta_offsets_;  // like row_offsets_, for the changed-cell encoding
+    int prev_width_ = -1, prev_height_ = -1;
+    std::vector<uint8_t> held_glyphs_;   // previous frame's cells, for tone/colour hysteresis
+    std::vector<uint32_t> held_colors_;
+    std::vector<uint32_t> held_backgrounds_;
+    int held_width_ = -1, held_height_ = -1;
+    bool hold_colors_ = false;           // this frame compares colours against held_colors_
+    std::string frame_;                // convert_to() staging buffer
+
+    // Sampling plan for one (source size, target size, filter) geometry. Only
+    // rebuilt when that changes, so fixed-size playback frames skip all the
+    // ratio/clamp/index math.
+    struct SamplePlan {
+        int src_width = -1, src_height = -1, channels = -1;
+        int width = -1, height = -1;
+        Filter filter = Filter::NEAREST;
+        std::vector<int> col_offset;     // source byte offset of each output column
+        std::vector<int> col_extent;     // BOX: source columns covered, BILINEAR: right weight
+        std::vector<size_t> row_offset;  // source byte offset of each output row
+        std::vector<int> row_extent;     // BOX: source rows covered, BILINEAR: lower weight
+    };
+    SamplePlan plan_;
 
-    uint8_t get_pixel_value(const Image& image, int x, int y, int channel = 0) const;
+    const SamplePlan& sampling_plan(const Image& image, int width, int height);
+    size_t band_accumulator_size(const Image& image) const;
+    size_t band_lerp_size(int width) const;
+    using SampleRowFn = void (Interpreter::*)(const Image&, const SamplePlan&, int, uint8_t*, uint32_t*, uint16_t*) const;
+    template <Filter F, int Channels>
+    void sample_row(const Image& image, const SamplePlan& plan, int y, uint8_t* rgb, uint32_t* acc, uint16_t* lerp) const;
+    static SampleRowFn row_sampler(Filter filter, int channels);
+
+    const SamplePlan& frame_plan(const Image& image);
+    void convert_impl(const Image& image, std::string& out, bool delta);
+    template <bool Color, ColorDepth Depth>
+    void convert_frame(const Image& image, const SamplePlan& plan, std::string& out, bool delta);
+    template <ColorDepth Depth>
+    void quantize_row(const uint8_t* rgb, int width, int y, int drop_bits, uint32_t* colors,
+                      const uint32_t* held) const;
+    template <bool Color, ColorDepth Depth>
+    void map_row(int y, int width, const uint8_t* rgb, uint8_t* tone, int drop_bits);
+    bool two_color_mode() const {
+        return config_.mode == Mode::HALF_BLOCK || config_.mode == Mode::QUADRANT || config_.mode == Mode::SEXTANT;
+    }
+    void hold_tone_row(int y, int width, const uint8_t* rgb, uint8_t* tone);
+    template <ColorDepth Depth>
+    void merge_row_colors(int y, int width, int max_distance2);
+    template <bool Color, ColorDepth Depth, typename Writer>
+    void encode_row(Writer& out, const Charset& charset, int y, int width) const;
+    template <bool Color, ColorDepth Depth, typename Writer>
+    void encode_row_delta(Writer& out, const Charset& charset, int y, int width) const;
+    int row_band_count(int rows) const;
+    template <typename Fn>
+    void for_each_row_band(int rows, const Fn& fn);
 };
 
 }
\ No newline at end of file
@@ -31,6 +31,51 @@ static std::string to_lower(std::string s) {
     return s;
 }
 
+// Guess what the terminal can show from the environment: COLORTERM=truecolor|24bit
+// is the usual truecolor hint, otherwise TERM tells 256-colour apart from basic ones.
+// Output that isn't going to a terminal keeps full truecolor.
+static ascii_art::ColorDepth detect_color_depth() {
+#if defined(_WIN32) || defined(_WIN64)
+    return ascii_art::ColorDepth::TRUECOLOR; // VT mode consoles all do 24-bit
+#else
+    if (!isatty(fileno(stdout))) return ascii_art::ColorDepth::TRUECOLOR;
+    const char* colorterm = std::getenv("COLORTERM");
+    if (colorterm) {
+        std::string ct = to_lower(colorterm);
+        if (ct == "truecolor" || ct == "24bit") return ascii_art::ColorDepth::TRUECOLOR;
+    }
+    const char* term_env = std::getenv("TERM");
+    std::string term = term_env ? to_lower(term_env) : std::string();
+    if (term.find("direct") != std::string::npos || term.find("truecolor") != std::string::npos) {
+        return ascii_art::ColorDepth::TRUECOLOR;
+    }
+    if (term.find("256") != std::string::npos) return ascii_art::ColorDepth::ANSI256;
+    if (term.empty()) return ascii_art::ColorDepth::TRUECOLOR; // not a terminal we know anything about
+    // xterm/screen/tmux without a suffix still do 256 everywhere that matters
+    if (term.rfind("xterm", 0) == 0 || term.rfind("screen", 0) == 0 || term.rfind("tmux", 0) == 0) {
+        return ascii_art::ColorDepth::ANSI256;
+    }
+    return ascii_art::ColorDepth::ANSI16;
+#endif
+}
+
+// Visible terminal size in cells; false when stdout isn't a terminal.
+static bool terminal_size(int& cols, int& rows) {
+#if defined(_WIN32) || defined(_WIN64)
+    HANDLE h = GetStdHandle(STD_OUTPUT_HANDLE);
+    CONSOLE_SCREEN_BUFFER_INFO csbi;
+    if (GetFileType(h) != FILE_TYPE_CHAR || !GetConsoleScreenBufferInfo(h, &csbi)) return false;
+    cols = csbi.srWindow.Right - csbi.srWindow.Left + 1;
+    rows = csbi.srWindow.Bottom - csbi.srWindow.Top + 1;
+#else
+    struct winsize ws;
+    if (!isatty(fileno(stdout)) || ioctl(fileno(stdout), TIOCGWINSZ, &ws) != 0) return false;
+    cols = ws.ws_col;
+    rows = ws.ws_row;
+#endif
+    return cols > 0 && rows > 0;
+}
+
 int main(int argc, char** argv) {
 #if defined(_WIN32) || defined(_WIN64)
     _setmode(_fileno(stdout), _O_BINARY);
@@ -55,7 +100,7 @@ int main(int argc, char** argv) {
 #endif
     if (argc < 4) {
         std::cerr << "Usage: " << argv[0] << " IMAGE STYLE COLORS [WIDTH] [ANIMATE]\n";
-        std::cerr << "  STYLE: clean | high_fidelity | block\n";
+        std::cerr << "  STYLE: clean | high_fidelity | block | half_block | braille | quadrant | sextant | edge | shape\n";
         std::cerr << "  COLORS: yes | no\n";
         std::cerr << "  ANIMATE: yes | no  (optional; only affects GIFs)\n";
         return 1;
@@ -103,6 +148,17 @@ int main(int argc, char** argv) {
     int min_delay_override = -1;
     double char_aspect_override = 0.0;
     bool force_unicode = false;
+    int threads = 1;
+    std::string filter_str = "nearest";
+    std::string depth_str = "auto";
+    std::string tone_dither_str = "none";
+    bool dither_colors = false;
+    double color_tolerance = 0.0;
+    long long frame_byte_budget = 0;
+    bool compress_runs = false;
+    bool braille_dither = false;
+    double edge_threshold = -1.0;
+    double hysteresis = 0.0;
     //any extra positional args (after the first 3) can be width or animate flag in any order.
     for (int i = 4; i < argc; ++i) {
         std::string s = to_lower(argv[i]);
@@ -155,6 +211,93 @@ int main(int argc, char** argv) {
             }
             continue;
         }
+        // --threads=N (0 = all hardware threads)
+        if (s.rfind("--threads=", 0) == 0 || s.rfind("threads=", 0) == 0) {
+            auto eq = s.find('=');
+            if (eq != std::string::npos) {
+                try { threads = std::stoi(s.substr(eq+1)); } catch(...) {}
+            }
+            continue;
+        }
+        if (s == "--threads" && i+1 < argc) {
+            try { threads = std::stoi(argv[++i]); } catch(...) {}
+            continue;
+        }
+        // --filter=nearest|box|bilinear
+        if (s.rfind("--filter=", 0) == 0 || s.rfind("filter=", 0) == 0) {
+            filter_str = s.substr(s.find('=') + 1);
+            continue;
+        }
+        if (s == "--filter" && i+1 < argc) {
+            filter_str = to_lower(argv[++i]);
+            continue;
+        }
+        // --color-depth=auto|truecolor|256|16
+        if (s.rfind("--color-depth=", 0) == 0 || s.rfind("color-depth=", 0) == 0) {
+            depth_str = s.substr(s.find('=') + 1);
+            continue;
+        }
+        if (s == "--color-depth" && i+1 < argc) {
+            depth_str = to_lower(argv[++i]);
+            continue;
+        }
+        // --tone-dither=none|bayer|fs
+        if (s.rfind("--tone-dither=", 0) == 0 || s.rfind("tone-dither=", 0) == 0) {
+            tone_dither_str = s.substr(s.find('=') + 1);
+            continue;
+        }
+        if (s == "--tone-dither" && i+1 < argc) {
+            tone_dither_str = to_lower(argv[++i]);
+            continue;
+        }
+        // --color-tolerance=DE merges neighbouring colours closer than DE (CIELAB)
+        if (s.rfind("--color-tolerance=", 0) == 0 || s.rfind("color-tolerance=", 0) == 0) {
+            try { color_tolerance = std::stod(s.substr(s.find('=') + 1)); } catch(...) {}
+            continue;
+        }
+        if (s == "--color-tolerance" && i+1 < argc) {
+            try { color_tolerance = std::stod(argv[++i]); } catch(...) {}
+            continue;
+        }
+        // --frame-bytes=N caps each colour frame at N bytes (coarser colours when over)
+        if (s.rfind("--frame-bytes=", 0) == 0 || s.rfind("frame-bytes=", 0) == 0) {
+            try { frame_byte_budget = std::stoll(s.substr(s.find('=') + 1)); } catch(...) {}
+            continue;
+        }
+        if (s == "--frame-bytes" && i+1 < argc) {
+            try { frame_byte_budget = std::stoll(argv[++i]); } catch(...) {}
+            continue;
+        }
+        // --edge-threshold=F sets how strong a gradient must be for an edge glyph (edge style)
+        if (s.rfind("--edge-threshold=", 0) == 0 || s.rfind("edge-threshold=", 0) == 0) {
+            try { edge_threshold = std::stod(s.substr(s.find('=') + 1)); } catch(...) {}
+            continue;
+        }
+        if (s == "--edge-threshold" && i+1 < argc) {
+            try { edge_threshold = std::stod(argv[++i]); } catch(...) {}
+            continue;
+        }
+        // --hysteresis=F holds glyphs/colours across frames until they change by more than F
+        if (s.rfind("--hysteresis=", 0) == 0 || s.rfind("hysteresis=", 0) == 0) {
+            try { hysteresis = std::stod(s.substr(s.find('=') + 1)); } catch(...) {}
+            continue;
+        }
+        if (s == "--hysteresis" && i+1 < argc) {
+            try { hysteresis = std::stod(argv[++i]); } catch(...) {}
+            continue;
+        }
+        if (s == "--braille-dither") {
+            braille_dither = true;
+            continue;
+        }
+        if (s == "--compress-runs") {
+            compress_runs = true;
+            continue;
+        }
+        if (s == "--dither-colors") {
+            dither_colors = true;
+            continue;
+        }
         if (s == "--force-unicode" || s == "--unicode") {
             force_unicode = true;
             continue;
@@ -172,6 +315,7 @@ int main(int argc, char** argv) {
 #endif
     }
     cfg.force_unicode = force_unicode;
+    cfg.threads = threads;
 
     // If user didn't explicitly request Unicode blocks, auto-enable them when
     // running inside Windows Terminal (WT_SESSION) which supports these glyphs.
@@ -217,11 +361,64 @@ int main(int argc, char** argv) {
         cfg.mode = ascii_art::Mode::HIGH_FIDELITY;
     } else if (style_str == "block" || style_str == "b") {
         cfg.mode = ascii_art::Mode::BLOCK;
+    } else if (style_str == "half_block" || style_str == "half" || style_str == "hb") {
+        cfg.mode = ascii_art::Mode::HALF_BLOCK;
+    } else if (style_str == "braille" || style_str == "br") {
+        cfg.mode = ascii_art::Mode::BRAILLE;
+    } else if (style_str == "quadrant" || style_str == "quad" || style_str == "q") {
+        cfg.mode = ascii_art::Mode::QUADRANT;
+    } else if (style_str == "sextant" || style_str == "sext") {
+        cfg.mode = ascii_art::Mode::SEXTANT;
+    } else if (style_str == "edge" || style_str == "e") {
+        cfg.mode = ascii_art::Mode::EDGE;
+    } else if (style_str == "shape") {
+        cfg.mode = ascii_art::Mode::SHAPE;
     } else {
         std::cerr << "Unknown style: " << argv[2] << "\n";
         return 2;
     }
 
+    if (filter_str == "nearest" || filter_str == "n") {
+        cfg.filter = ascii_art::Filter::NEAREST;
+    } else if (filter_str == "box" || filter_str == "area") {
+        cfg.filter = ascii_art::Filter::BOX;
+    } else if (filter_str == "bilinear" || filter_str == "linear") {
+        cfg.filter = ascii_art::Filter::BILINEAR;
+    } else {
+        std::cerr << "Unknown filter: " << filter_str << "\n";
+        return 2;
+    }
+
+    if (depth_str == "auto") {
+        cfg.color_depth = detect_color_depth();
+    } else if (depth_str == "truecolor" || depth_str == "24bit" || depth_str == "24") {
+        cfg.color_depth = ascii_art::ColorDepth::TRUECOLOR;
+    } else if (depth_str == "256") {
+        cfg.color_depth = ascii_art::ColorDepth::ANSI256;
+    } else if (depth_str == "16") {
+        cfg.color_depth = ascii_art::ColorDepth::ANSI16;
+    } else {
+        std::cerr << "Unknown color depth: " << depth_str << "\n";
+        return 2;
+    }
+    if (tone_dither_str == "bayer" || tone_dither_str == "ordered") {
+        cfg.tone_dither = ascii_art::ToneDither::BAYER;
+    } else if (tone_dither_str == "fs" || tone_dither_str == "floyd-steinberg") {
+        cfg.tone_dither = ascii_art::ToneDither::FLOYD_STEINBERG;
+    } else if (tone_dither_str != "none") {
+        std::cerr << "Unknown tone dither: " << tone_dither_str << "\n";
+        return 2;
+    }
+    cfg.color_dither = dither_colors;
+    cfg.color_tolerance = static_cast<float>(color_tolerance);
+    cfg.compress_runs = compress_runs;
+    cfg.braille_dither = braille_dither;
+    if (edge_threshold >= 0.0) cfg.edge_threshold = static_cast<float>(edge_threshold);
+    // F glyph steps of tone, and a colour band of 6F Delta E (about one 256-colour step at F = 1)
+    cfg.tone_hysteresis = static_cast<float>(hysteresis);
+    cfg.color_hysteresis = static_cast<float>(hysteresis * 6.0);
+    if (frame_byte_budget > 0) cfg.frame_byte_budget = static_cast<size_t>(frame_byte_budget);
+
     if (colors_str == "yes" || colors_str == "y" || colors_str == "true" || colors_str == "1") {
         cfg.use_color = true;
     } else if (colors_str == "no" || colors_str == "n" || colors_str == "false" || colors_str == "0") {
@@ -247,31 +444,49 @@ int main(int argc, char** argv) {
     std::string extension = (ext_pos == std::string::npos) ? std::string() : to_lower(image_path.substr(ext_pos + 1));
 
     if (extension == "gif" && animate) {
-        // read file into memory (fucking hell)
-        std::ifstream file(image_path, std::ios::binary | std::ios::ate);
-        if (!file) {
-            std::cerr << "Cannot open file: " << image_path << "\n";
+        // map the file (no copy) and decode every frame from it
+        std::unique_ptr<ascii_art::MappedFile> file;
+        try {
+            file = std::make_unique<ascii_art::MappedFile>(image_path);
+        } catch (const std::exception& e) {
+            std::cerr << e.what() << "\n";
             return 4;
         }
-        std::streamsize size = file.tellg();
-        file.seekg(0, std::ios::beg);
-        std::vector<unsigned char> buffer((size_t)size);
-        if (!file.read(reinterpret_cast<char*>(buffer.data()), size)) {
-            std::cerr << "Failed to read file: " << image_path << "\n";
+
+        if (file->size() > static_cast<size_t>(INT32_MAX)) {
+            std::cerr << "Image file too large: " << image_path << "\n";
             return 4;
         }
 
         int *delays = nullptr;
         int w=0, h=0, frames=0, comp=0;
-        unsigned char* gif_data = stbi_load_gif_from_memory(buffer.data(), (int)buffer.size(), &delays, &w, &h, &frames, &comp, 3);
+        unsigned char* gif_data = stbi_load_gif_from_memory(file->data(), (int)file->size(), &delays, &w, &h, &frames, &comp, 3);
+        file.reset();  // only the decoded frames are needed from here on
         if (!gif_data) {
             std::cerr << "Failed to decode GIF: " << image_path << "\n";
             return 5;
         }
 
+        // delta frames place cells with absolute cursor moves, so the whole frame has to fit:
+        // one as tall as the terminal scrolls it (each frame ends in '\n') and every later
+        // delta lands on the wrong rows. Shrink to rows-1, keeping the aspect ratio.
+        auto fit_to_terminal = [&]() {
+            int cols = 0, rows = 0;
+            if (!terminal_size(cols, rows)) return;
+            int fit_width = std::min(width, cols);
+            int fit_height = 0;
+            if (rows > 1 && static_cast<int>(fit_width * h * cfg.char_aspect_ratio / w) > rows - 1) {
+                fit_height = rows - 1;
+                fit_width = std::max(1, static_cast<int>(fit_height * w / (h * cfg.char_aspect_ratio)));
+            }
+            interp.set_target_size(fit_width, fit_height);
+        };
+        fit_to_terminal();
+
     // clear
     write_to_console("\x1b[2J", false);
     write_to_console("\x1b[?25l", false);
+        interp.reset_delta();  // the next frame can't assume anything about the screen
 
         const int frame_bytes = w * h * 3;
 
@@ -279,6 +494,12 @@ int main(int argc, char** argv) {
         static volatile sig_atomic_t g_stop = 0;
         auto handle_sigint = [](int){ g_stop = 1; };
         std::signal(SIGINT, handle_sigint);
+        // a resize reflows whatever is on screen, so refit and redraw in full
+        static volatile sig_atomic_t g_resized = 0;
+#ifdef SIGWINCH
+        auto handle_sigwinch = [](int){ g_resized = 1; };
+        std::signal(SIGWINCH, handle_sigwinch);
+#endif
 
         const int kDefaultDelayCs = 100;
         const int kDefaultDelayMs = kDefaultDelayCs * 10;
@@ -290,17 +511,23 @@ int main(int argc, char** argv) {
         auto next_frame_time = std::chrono::steady_clock::now();
 
         // playback loop so iterate frames repeatedly until SIGINT
+        // each frame is a borrowed view into the decoded GIF (no copy), and the output
+        // buffer is reused so steady-state playback doesn't allocate
+        std::string out;
         int f = 0;
         while (!g_stop) {
-            unsigned char* src = gif_data + (size_t)f * frame_bytes;
-            ascii_art::Image image(w, h, 3);
-            ::memcpy(image.data.data(), src, frame_bytes);
-
-            // Convert and render as fast as possible but using timing below to stay accurate
-            std::string out = interp.convert(image);
+            const ascii_art::Image image(gif_data + (size_t)f * frame_bytes, w, h, 3, nullptr);
+            if (g_resized) {
+                g_resized = 0;
+                fit_to_terminal();
+                write_to_console("\x1b[2J", false);
+                interp.reset_delta();
+            }
 
-            // move cursor home and print frame
-            write_to_console("\x1b[H", false);
+            // Convert and render as fast as possible but using timing below to stay accurate.
+            // convert_delta only sends the cells that changed since the last frame we printed
+            // (or cursor home + the whole frame when that is smaller)
+            interp.convert_delta(image, out);
             write_to_console(out, true);
 
             // Determine this frame's delay (in ms). GIF delays are in centiseconds (w trivia?)